@@ -11,6 +11,13 @@
 #include <time.h>
 #include <string.h>
 #include <float.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -28,10 +35,31 @@ int32_t scroll_x, scroll_y;
 int32_t prev_scroll_x, prev_scroll_y;
 float window_width = 640, window_height = 480;
 float fovy = 60;
-float near = 0.1;
-float far = 100;
+float near = 0.5;
+float far = 1500;		// chunks past LOD_PROXY_DIST are drawn with less detail
 
 uint8_t enable_physics_draw = 0;
+uint8_t enable_occlusion_culling = 1;
+uint8_t enable_profiler = 0;		// print per-pass timings (F3)
+uint32_t headless_frames = 0;	// frames to benchmark offscreen (--headless N); 0 for the normal window
+uint32_t capture_every = 0;		// capture every Nth frame (--capture-every N); 0 for none
+uint8_t capture_raw = 0;		// write captures as binary PPM instead of PNG (--capture-raw)
+uint8_t capture_requested = 0;	// capture the next frame (F2); main thread
+
+#define BRICK_RENDER_CHUNKS 0	// static bricks are baked into chunk meshes
+#define BRICK_RENDER_PULL 1		// default-mesh bricks are drawn instanced, via vertex pulling
+uint8_t brick_render_mode = BRICK_RENDER_CHUNKS;
+
+// render state changed from the main thread (input, window events). the render thread only sees it
+// through render packets, copying it into window_width, window_height, brick_render_mode and
+// enable_profiler before each frame
+typedef struct render_settings_t {
+	float window_width, window_height;
+	uint8_t brick_render_mode;
+	uint8_t enable_profiler;
+} render_settings_t;
+
+render_settings_t settings = { 640, 480, BRICK_RENDER_CHUNKS, 0 };
 
 typedef struct vec2 { float x,y; } vec2;
 typedef struct vec3 { float x,y,z; } vec3;
@@ -45,6 +73,13 @@ typedef struct collision_t collision_t;
 typedef struct camera_t camera_t;
 void add_brick_collider_aabb(int32_t brick_id);
 uint32_t add_collider_aabb(vec3 pos, vec3 scale);
+void dirty_brick(uint32_t brick_id);
+void chunk_remove_brick(uint32_t brick_id);
+void pull_mark_dirty(uint32_t brick_id);
+uint8_t gpu_culls_brick(uint32_t brick_id);
+uint8_t gpu_culls_pulled_bricks();
+void minimap_mark_dirty(vec3 min, vec3 max);
+uint16_t float_to_half(float f);
 
 typedef struct camera_t {
 	vec3 pos;
@@ -61,6 +96,8 @@ typedef struct player_t {
 	uint8_t selection_mode;		// 0 = selected, 1 = scale, 2 = translate, 3 = color
 	uint8_t selection_colors[3];	// the new color for selected brick
 	uint8_t n_selection_colors;	// which of R, G, B the current color selection is on 0-2
+	uint8_t show_preview;		// outline where a placed brick would go
+	vec3 preview_pos, preview_size;
 } player_t;
 
 player_t* player;
@@ -70,105 +107,291 @@ player_t* player;
 /*				MESH DATA AND MANAGEMENT			*/
 /*==================================================*/
 
-typedef struct mesh_t {
+// meshes are suballocated from large shared buffers, one mesh pool per vertex layout, so every mesh
+// of a pool is drawn through the pool's VAO with a base vertex and an offset into its index buffer.
+// free space is kept in sorted free lists (first fit; released space is merged with its neighbors).
+// when nothing fits, a pool's buffers grow in place (keeping their names, so VAOs stay valid).
+
+#define POOL_VERTICES 65536			// initial capacity of a pool, in vertices
+#define POOL_SLOTS 98304			// initial capacity of a pool's index buffer, in 4-byte slots
+
+typedef struct pool_block_t {
+	uint32_t offset, size;
+} pool_block_t;
+
+typedef struct pool_heap_t {
+	pool_block_t* free;			// sorted by offset, never touching
+	uint32_t n_free, max_free;
+	uint32_t capacity;
+} pool_heap_t;
+
+typedef struct mesh_pool_t {
 	GLuint vbo_id, ibo_id, vao_id;
+	uint32_t stride;
+	pool_heap_t vertices;		// in vertices
+	pool_heap_t slots;			// in 4-byte index slots (16-bit indices take half a slot each)
+} mesh_pool_t;
+
+// a mesh's space in a pool
+typedef struct pool_range_t {
+	uint32_t base_vertex, n_vertices;
+	uint32_t first_slot, n_slots;
 	uint32_t n_indices;
-	uint32_t vtx_format;				// 0 = v3 pos, 1 = v3 pos v3 norm (default mesh), 2 = v3 pos v3 norm v2 tex
-	uint8_t has_ibo;
+	GLenum index_type;			// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+} pool_range_t;
+
+typedef struct mesh_t {
+	uint32_t vtx_format;		// 0 = v3 pos, 1 = v3 pos v3 norm (default mesh), 2 = v3 pos v3 norm v2 tex, 3 = packed
+	pool_range_t range;			// in mesh_pool, as vtx_format 3 with 32-bit indices
 } mesh_t;
 
 mesh_t* meshes;
 uint32_t n_meshes;
 
-// create a mesh and return the mesh ID
-uint32_t create_mesh(float* vtx_data, uint16_t* idx_data, uint32_t vbo_size, uint32_t ibo_size, uint32_t vtx_format) {
+// return space to a heap, merging it with the free blocks it touches
+void __heap_free(pool_heap_t* heap, uint32_t offset, uint32_t size) {
+	if(!size) return;
+	uint32_t i = 0;
+	while(i < heap->n_free && heap->free[i].offset < offset) i++;
+	uint8_t joins_prev = i > 0 && heap->free[i-1].offset + heap->free[i-1].size == offset;
+	uint8_t joins_next = i < heap->n_free && offset + size == heap->free[i].offset;
+	if(joins_prev && joins_next) {
+		heap->free[i-1].size += size + heap->free[i].size;
+		memmove(&heap->free[i], &heap->free[i+1], sizeof(pool_block_t)*(heap->n_free-i-1));
+		heap->n_free--;
+	} else if(joins_prev) heap->free[i-1].size += size;
+	else if(joins_next) heap->free[i].offset = offset, heap->free[i].size += size;
+	else {
+		if(heap->n_free == heap->max_free) {
+			heap->max_free = heap->max_free ? heap->max_free*2 : 64;
+			heap->free = realloc(heap->free, sizeof(pool_block_t)*heap->max_free);
+		}
+		memmove(&heap->free[i+1], &heap->free[i], sizeof(pool_block_t)*(heap->n_free-i));
+		heap->free[i].offset = offset, heap->free[i].size = size;
+		heap->n_free++;
+	}
+}
+
+// take size units from the first free block large enough; returns UINT32_MAX if there is none
+uint32_t __heap_alloc(pool_heap_t* heap, uint32_t size) {
+	for(uint32_t i = 0; i < heap->n_free; i++) {
+		pool_block_t* block = &heap->free[i];
+		if(block->size < size) continue;
+		uint32_t offset = block->offset;
+		block->offset += size, block->size -= size;
+		if(!block->size) {
+			memmove(block, block+1, sizeof(pool_block_t)*(heap->n_free-i-1));
+			heap->n_free--;
+		}
+		return offset;
+	}
+	return UINT32_MAX;
+}
+
+// resize a buffer, keeping its name and its first n_bytes
+void __grow_pool_buffer(GLuint buffer_id, uint32_t n_bytes, uint32_t new_size) {
+	GLuint copy_id;
+	glGenBuffers(1,&copy_id);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer_id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, copy_id);
+	glBufferData(GL_COPY_WRITE_BUFFER, n_bytes, 0, GL_STREAM_COPY);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, n_bytes);
+	glBufferData(GL_COPY_READ_BUFFER, new_size, 0, GL_STATIC_DRAW);
+	glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, n_bytes);
+	glDeleteBuffers(1,&copy_id);
+}
+
+// allocate from one of a pool's heaps, growing its buffer (at least doubling it) if nothing fits
+uint32_t __pool_reserve(pool_heap_t* heap, GLuint buffer_id, uint32_t unit_size, uint32_t size) {
+	if(!size) return 0;
+	uint32_t offset = __heap_alloc(heap, size);
+	if(offset != UINT32_MAX) return offset;
+	uint32_t capacity = heap->capacity*2 > heap->capacity+size ? heap->capacity*2 : heap->capacity+size;
+	__grow_pool_buffer(buffer_id, heap->capacity*unit_size, capacity*unit_size);
+	__heap_free(heap, heap->capacity, capacity - heap->capacity);
+	heap->capacity = capacity;
+	return __heap_alloc(heap, size);
+}
+
+// create a pool's buffers and VAO; the VAO is left bound, for the caller to set up its vertex attributes
+void init_mesh_pool(mesh_pool_t* pool, uint32_t stride) {
+	memset(pool,0,sizeof(mesh_pool_t));
+	pool->stride = stride;
+	GLuint buffers[2];
+	glGenBuffers(2,buffers);
+	pool->vbo_id = buffers[0], pool->ibo_id = buffers[1];
+	glGenVertexArrays(1,&pool->vao_id);
+	glBindVertexArray(pool->vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER,pool->vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, stride*POOL_VERTICES, 0, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,pool->ibo_id);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, 4*POOL_SLOTS, 0, GL_STATIC_DRAW);
+	pool->vertices.capacity = POOL_VERTICES;
+	pool->slots.capacity = POOL_SLOTS;
+	__heap_free(&pool->vertices, 0, POOL_VERTICES);
+	__heap_free(&pool->slots, 0, POOL_SLOTS);
+}
+
+// copy a mesh into a pool; indices are relative to the mesh's first vertex
+pool_range_t pool_add_mesh(mesh_pool_t* pool, const void* vtx_data, uint32_t n_vertices, const void* idx_data, uint32_t n_indices, GLenum index_type) {
+	pool_range_t range;
+	range.n_vertices = n_vertices;
+	range.n_indices = n_indices;
+	range.index_type = index_type;
+	range.n_slots = index_type == GL_UNSIGNED_SHORT ? (n_indices+1)/2 : n_indices;
+	range.base_vertex = __pool_reserve(&pool->vertices, pool->vbo_id, pool->stride, n_vertices);
+	range.first_slot = __pool_reserve(&pool->slots, pool->ibo_id, 4, range.n_slots);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool->vbo_id);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.base_vertex*pool->stride, n_vertices*pool->stride, vtx_data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool->ibo_id);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.first_slot*4, n_indices*(index_type == GL_UNSIGNED_SHORT ? 2 : 4), idx_data);
+	return range;
+}
+
+void pool_remove_mesh(mesh_pool_t* pool, pool_range_t* range) {
+	__heap_free(&pool->vertices, range->base_vertex, range->n_vertices);
+	__heap_free(&pool->slots, range->first_slot, range->n_slots);
+	memset(range,0,sizeof(pool_range_t));
+}
+
+// draw a mesh (its pool's VAO bound)
+void draw_pool_range(pool_range_t* range) {
+	glDrawElementsBaseVertex(GL_TRIANGLES, range->n_indices, range->index_type, (void*)(uintptr_t)(range->first_slot*4), range->base_vertex);
+}
+
+// vtx_format 3 packs the vtx_format 2 attributes into 16 bytes: half float position, normal in
+// GL_INT_2_10_10_10_REV and half float texture coordinates (half of the float layout)
+typedef struct packed_vertex_t {
+	uint16_t pos[4];		// w unused
+	uint32_t norm;
+	uint16_t tex[2];
+} packed_vertex_t;
+
+// pack a normal into GL_INT_2_10_10_10_REV (signed normalized x, y, z; w = 0)
+uint32_t __pack_normal(float x, float y, float z) {
+	float n[3] = { x,y,z };
+	uint32_t packed = 0;
+	for(uint32_t i = 0; i < 3; i++) {
+		int32_t v = roundf(fminf(fmaxf(n[i],-1),1)*511);
+		packed |= (uint32_t)(v & 0x3FF) << (i*10);
+	}
+	return packed;
+}
+
+// pack vertices of vtx_format 0-2 (given their stride) into vtx_format 3, with zeroed normals or
+// texture coordinates where the format has none
+void pack_vertices(const float* vtx_data, uint32_t n_vertices, uint32_t stride, packed_vertex_t* out) {
+	for(uint32_t i = 0; i < n_vertices; i++) {
+		float v[8] = { 0 };
+		memcpy(v, &vtx_data[i*stride/4], stride);
+		out[i].pos[0] = float_to_half(v[0]), out[i].pos[1] = float_to_half(v[1]), out[i].pos[2] = float_to_half(v[2]);
+		out[i].pos[3] = 0;
+		out[i].norm = __pack_normal(v[3], v[4], v[5]);
+		out[i].tex[0] = float_to_half(v[6]), out[i].tex[1] = float_to_half(v[7]);
+	}
+}
+
+// every mesh is stored in one pool in the vtx_format 3 layout, with 32-bit indices (generated for meshes
+// without an IBO), so bricks with different meshes can be drawn by one indirect call.
+mesh_pool_t mesh_pool;
+
+// create the mesh pool; instance attributes 5-11 are set per draw (see submit_brick_draws)
+void init_mesh_pool_layout() {
+	init_mesh_pool(&mesh_pool, sizeof(packed_vertex_t));
+	glVertexAttribPointer(0,3,GL_HALF_FLOAT,GL_FALSE,sizeof(packed_vertex_t),(void*)offsetof(packed_vertex_t,pos));
+	glVertexAttribPointer(1,4,GL_INT_2_10_10_10_REV,GL_TRUE,sizeof(packed_vertex_t),(void*)offsetof(packed_vertex_t,norm));
+	glVertexAttribPointer(2,2,GL_HALF_FLOAT,GL_FALSE,sizeof(packed_vertex_t),(void*)offsetof(packed_vertex_t,tex));
+	for(uint32_t a = 0; a < 3; a++)
+		glEnableVertexAttribArray(a);
+	for(uint32_t a = 5; a < 12; a++) {
+		glEnableVertexAttribArray(a);
+		glVertexAttribDivisor(a,1);
+	}
+}
+
+// create a mesh from vertices of the given vtx_format and 16- or 32-bit indices (idx_size 2 or 4;
+// without indices, every 3 vertices are a triangle), and return the mesh ID
+uint32_t __create_mesh(void* vtx_data, void* idx_data, uint32_t idx_size, uint32_t vbo_size, uint32_t ibo_size, uint32_t vtx_format) {
 	uint32_t stride = 0;
 	switch(vtx_format) {
 		case 0: stride = 12; break;
 		case 1: stride = 24; break;
 		case 2: stride = 32; break;
+		case 3: stride = sizeof(packed_vertex_t); break;
 		default: printf("internal error: create_mesh given invalid vtx_format\n"); exit(1);
 	}
-
-	GLuint buffers[2];
-	glGenBuffers(2,buffers);
-	glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
-	glBufferData(GL_ARRAY_BUFFER, vbo_size, vtx_data, GL_STATIC_DRAW);
-	if(idx_data) {
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,buffers[1]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,ibo_size,idx_data,GL_STATIC_DRAW);
-	}
-	GLuint vao_id = 0;
-	glGenVertexArrays(1,&vao_id);
-	glBindVertexArray(vao_id);
-	glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
-	if(idx_data) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,buffers[1]);
-	switch(vtx_format) {
-		case 0:			// v3 pos
-			glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,stride,0);
-			glEnableVertexAttribArray(0); break;
-		case 1:			// v3 pos, v3 norm
-			glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,stride,0);
-			glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,stride,(void*)12);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1); break;
-		case 2:			// v3 pos, v3 norm, v2 tex coord
-			glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,stride,0);
-			glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,stride,(void*)12);
-			glVertexAttribPointer(2,2,GL_FLOAT,GL_FALSE,stride,(void*)24);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
-			glEnableVertexAttribArray(2); break;
+	if(!mesh_pool.vao_id) init_mesh_pool_layout();
+	uint32_t n_vertices = vbo_size/stride;
+	uint32_t n_indices = idx_data ? ibo_size/idx_size : n_vertices;
+	packed_vertex_t* vertices = vtx_data;
+	if(vtx_format != 3) {
+		vertices = malloc(sizeof(packed_vertex_t)*n_vertices);
+		pack_vertices(vtx_data, n_vertices, stride, vertices);
 	}
+	uint32_t* indices = malloc(sizeof(uint32_t)*n_indices);
+	for(uint32_t i = 0; i < n_indices; i++)
+		indices[i] = !idx_data ? i : idx_size == 2 ? ((uint16_t*)idx_data)[i] : ((uint32_t*)idx_data)[i];
+
 	meshes = realloc(meshes, sizeof(mesh_t)*(n_meshes+1));
-	meshes[n_meshes].vbo_id = buffers[0];
-	meshes[n_meshes].ibo_id = buffers[1];
-	meshes[n_meshes].vao_id = vao_id;
-	meshes[n_meshes].n_indices = idx_data ? ibo_size/2 : vbo_size/stride;
 	meshes[n_meshes].vtx_format = vtx_format;
-	meshes[n_meshes].has_ibo = idx_data ? 1 : 0, meshes[n_meshes].ibo_id = buffers[1];
+	meshes[n_meshes].range = pool_add_mesh(&mesh_pool, vertices, n_vertices, indices, n_indices, GL_UNSIGNED_INT);
+	if(vertices != vtx_data) free(vertices);
+	free(indices);
 	return n_meshes++;
 }
 
-// create the default brick mesh (1x1x1)
-void init_mesh() {
-	// 12 triangles (36 indices)
-	uint16_t ibo_data[] = {
-		0, 	1,	2,	 2, 1, 	3,
-		4, 	5,	6,	 6, 5, 	7,
-		8, 	9, 	10, 10, 9, 	11,
-		12, 13, 14, 14, 13, 15,
-		16, 17, 18, 18, 17, 19,
-		20, 21, 22, 22, 21, 23 };
-	// 24 vertices (3 different vertices per corner, as each corner is shared by 3 faces)
-	float vbo_data[] = {
-		0, 0, 1,	0, 0, 1,	0, 0,		// face 0
-		1, 0, 1,	0, 0, 1,	0, 1,
-		0, 1, 1,	0, 0, 1,	1, 0,
-		1, 1, 1,	0, 0, 1,	1, 1,
-		0, 1, 1,	0, 1, 0,	0, 0,		// face 1
-		1, 1, 1,	0, 1, 0,	0, 1,
-		0, 1, 0,	0, 1, 0,	1, 0,
-		1, 1, 0,	0, 1, 0,	1, 1,
-		0, 1, 0,	0, 0, -1,	1, 1,		// face 2
-		1, 1, 0,	0, 0, -1,	0, 1,
-		0, 0, 0,	0, 0, -1,	1, 0,
-		1, 0, 0,	0, 0, -1,	0, 0,
-		0, 0, 0,	0, -1, 0,	0, 0,		// face 3
-		1, 0, 0,	0, -1, 0,	0, 1,
-		0, 0, 1,	0, -1, 0,	1, 0,
-		1, 0, 1,	0, -1, 0,	1, 1,
-		1, 0, 1,	1, 0, 0,	0, 0,		// face 4
-		1, 0, 0,	1, 0, 0,	0, 1,
-		1, 1, 1,	1, 0, 0,	1, 0,
-		1, 1, 0,	1, 0, 0,	1, 1,
-		0, 0, 0,	-1, 0, 0,	0, 0,		// face 5
-		0, 0, 1,	-1, 0, 0,	0, 1,
-		0, 1, 0,	-1, 0, 0,	1, 0,
-		0, 1, 1,	-1, 0, 0,	1, 1
-	};
+// create a mesh with 16-bit indices and return the mesh ID
+uint32_t create_mesh(void* vtx_data, uint16_t* idx_data, uint32_t vbo_size, uint32_t ibo_size, uint32_t vtx_format) {
+	return __create_mesh(vtx_data, idx_data, 2, vbo_size, ibo_size, vtx_format);
+}
+
+// create a mesh with 32-bit indices (for meshes past 65536 vertices) and return the mesh ID
+uint32_t create_mesh_32(void* vtx_data, uint32_t* idx_data, uint32_t vbo_size, uint32_t ibo_size, uint32_t vtx_format) {
+	return __create_mesh(vtx_data, idx_data, 4, vbo_size, ibo_size, vtx_format);
+}
 
-	create_mesh(vbo_data, ibo_data, sizeof(vbo_data), sizeof(ibo_data), 2);
+// the default brick mesh (1x1x1)
+// 12 triangles (36 indices)
+const uint16_t cube_ibo_data[] = {
+	0, 	1,	2,	 2, 1, 	3,
+	4, 	5,	6,	 6, 5, 	7,
+	8, 	9, 	10, 10, 9, 	11,
+	12, 13, 14, 14, 13, 15,
+	16, 17, 18, 18, 17, 19,
+	20, 21, 22, 22, 21, 23 };
+// 24 vertices (3 different vertices per corner, as each corner is shared by 3 faces)
+const float cube_vbo_data[] = {
+	0, 0, 1,	0, 0, 1,	0, 0,		// face 0
+	1, 0, 1,	0, 0, 1,	0, 1,
+	0, 1, 1,	0, 0, 1,	1, 0,
+	1, 1, 1,	0, 0, 1,	1, 1,
+	0, 1, 1,	0, 1, 0,	0, 0,		// face 1
+	1, 1, 1,	0, 1, 0,	0, 1,
+	0, 1, 0,	0, 1, 0,	1, 0,
+	1, 1, 0,	0, 1, 0,	1, 1,
+	0, 1, 0,	0, 0, -1,	1, 1,		// face 2
+	1, 1, 0,	0, 0, -1,	0, 1,
+	0, 0, 0,	0, 0, -1,	1, 0,
+	1, 0, 0,	0, 0, -1,	0, 0,
+	0, 0, 0,	0, -1, 0,	0, 0,		// face 3
+	1, 0, 0,	0, -1, 0,	0, 1,
+	0, 0, 1,	0, -1, 0,	1, 0,
+	1, 0, 1,	0, -1, 0,	1, 1,
+	1, 0, 1,	1, 0, 0,	0, 0,		// face 4
+	1, 0, 0,	1, 0, 0,	0, 1,
+	1, 1, 1,	1, 0, 0,	1, 0,
+	1, 1, 0,	1, 0, 0,	1, 1,
+	0, 0, 0,	-1, 0, 0,	0, 0,		// face 5
+	0, 0, 1,	-1, 0, 0,	0, 1,
+	0, 1, 0,	-1, 0, 0,	1, 0,
+	0, 1, 1,	-1, 0, 0,	1, 1
+};
+
+// create the default brick mesh (packed; cube_vbo_data itself is kept for baking and physics)
+void init_mesh() {
+	packed_vertex_t cube_vertices[24];
+	pack_vertices(cube_vbo_data, 24, 32, cube_vertices);
+	create_mesh(cube_vertices, (uint16_t*)cube_ibo_data, sizeof(cube_vertices), sizeof(cube_ibo_data), 3);
 }
 
 /*==================================================*/
@@ -178,27 +401,261 @@ void init_mesh() {
 GLuint* gl_textures;
 uint32_t n_textures;
 
-// return 0 on failure
-GLuint load_texture_from_file(char* path) {
-	uint32_t w, h, comp;
-	uint8_t* image = stbi_load(path, &w, &h, &comp, 0);
+// textures load asynchronously: load_texture_from_file returns at once with a transparent
+// placeholder (so only the brick color shows), while a loader thread decodes the image and builds
+// its mipmaps. update_textures then uploads finished images through a pixel buffer object, at most
+// TEXTURE_UPLOAD_BUDGET bytes per frame, smallest mip first; each completed level becomes the new
+// base level, so textures sharpen progressively instead of stalling a frame.
+// every loaded texture is also copied into a layer of one texture array (layer = index
+// in gl_textures), so baked chunk geometry can select textures per vertex
+#define TEXTURE_LAYER_SIZE 64
+#define TEXTURE_LAYER_LEVELS 7			// log2(TEXTURE_LAYER_SIZE)+1
+#define MAX_TEXTURE_LAYERS 63			// layer + 1 must fit in 6 bits (see packed_chunk_vertex_t)
+#define MAX_TEXTURE_LEVELS 16
+#define TEXTURE_LOADERS 2				// decoding threads
+#define TEXTURE_UPLOAD_BUDGET (256*1024)	// bytes per frame
+GLuint texture_array_id;
+
+typedef struct texture_request_t {
+	char* path;
+	GLuint tbo_id;
+	uint32_t layer;						// texture array layer, or MAX_TEXTURE_LAYERS if none
+	// filled in by the loader thread
+	uint8_t failed;
+	uint8_t* levels[MAX_TEXTURE_LEVELS];	// RGBA8 mip chain
+	uint32_t widths[MAX_TEXTURE_LEVELS], heights[MAX_TEXTURE_LEVELS];
+	uint32_t n_levels;
+	uint8_t* layer_levels[TEXTURE_LAYER_LEVELS];	// resampled to TEXTURE_LAYER_SIZE, with mips
+	// upload progress, on the main thread
+	uint8_t started;
+	int32_t level;
+	uint32_t row;
+	struct texture_request_t* next;
+} texture_request_t;
+
+texture_request_t* decode_queue, *decode_queue_tail;	// waiting for a loader thread
+texture_request_t* upload_queue, *upload_queue_tail;	// decoded, waiting for update_textures
+pthread_mutex_t texture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t texture_cond = PTHREAD_COND_INITIALIZER;
+pthread_t texture_loaders[TEXTURE_LOADERS];
+uint8_t texture_loaders_started;
+texture_request_t* uploading;			// request update_textures is partway through
+GLuint texture_pbo_id;
+uint8_t textures_updated;				// set when a texture finishes uploading; cleared by whoever redraws captures
+
+// build level n+1 of a mip chain from level n by averaging 2x2 blocks (edges clamped)
+uint8_t* __downsample(uint8_t* src, uint32_t w, uint32_t h, uint32_t* out_w, uint32_t* out_h) {
+	uint32_t dw = w > 1 ? w/2 : 1, dh = h > 1 ? h/2 : 1;
+	uint8_t* dst = malloc(dw*dh*4);
+	for(uint32_t y = 0; y < dh; y++)
+		for(uint32_t x = 0; x < dw; x++) {
+			uint32_t x0 = x*2, y0 = y*2;
+			uint32_t x1 = x0+1 < w ? x0+1 : x0, y1 = y0+1 < h ? y0+1 : y0;
+			for(uint32_t c = 0; c < 4; c++)
+				dst[(y*dw + x)*4 + c] = (src[(y0*w + x0)*4 + c] + src[(y0*w + x1)*4 + c]
+					+ src[(y1*w + x0)*4 + c] + src[(y1*w + x1)*4 + c] + 2) / 4;
+		}
+	*out_w = dw, *out_h = dh;
+	return dst;
+}
+
+// decode an image and build its mip chains (runs on a loader thread)
+void __decode_texture(texture_request_t* req) {
+	int w, h, comp;
+	uint8_t* image = stbi_load(req->path, &w, &h, &comp, 4);
 	if(!image) {
-		printf("internal error: failed to load texture from file %s\n", path);
-		return 0;
+		req->failed = 1;
+		return;
+	}
+	req->levels[0] = image;
+	req->widths[0] = w, req->heights[0] = h;
+	req->n_levels = 1;
+	while((req->widths[req->n_levels-1] > 1 || req->heights[req->n_levels-1] > 1) && req->n_levels < MAX_TEXTURE_LEVELS) {
+		uint32_t i = req->n_levels++;
+		req->levels[i] = __downsample(req->levels[i-1], req->widths[i-1], req->heights[i-1], &req->widths[i], &req->heights[i]);
+	}
+	if(req->layer == MAX_TEXTURE_LAYERS) return;
+	uint8_t* texels = malloc(TEXTURE_LAYER_SIZE*TEXTURE_LAYER_SIZE*4);		// nearest-neighbour resample
+	for(uint32_t y = 0; y < TEXTURE_LAYER_SIZE; y++)
+		for(uint32_t x = 0; x < TEXTURE_LAYER_SIZE; x++)
+			memcpy(&texels[(y*TEXTURE_LAYER_SIZE + x)*4], &image[((y*h/TEXTURE_LAYER_SIZE)*w + x*w/TEXTURE_LAYER_SIZE)*4], 4);
+	req->layer_levels[0] = texels;
+	uint32_t size = TEXTURE_LAYER_SIZE;
+	for(uint32_t i = 1; i < TEXTURE_LAYER_LEVELS; i++, size /= 2) {
+		uint32_t dw, dh;
+		req->layer_levels[i] = __downsample(req->layer_levels[i-1], size, size, &dw, &dh);
+	}
+}
+
+void* texture_loader_main(void* unused) {
+	pthread_mutex_lock(&texture_lock);
+	while(1) {
+		while(!decode_queue)
+			pthread_cond_wait(&texture_cond, &texture_lock);
+		texture_request_t* req = decode_queue;
+		decode_queue = req->next;
+		if(!decode_queue) decode_queue_tail = 0;
+		pthread_mutex_unlock(&texture_lock);
+		__decode_texture(req);
+		pthread_mutex_lock(&texture_lock);
+		req->next = 0;
+		if(upload_queue_tail) upload_queue_tail->next = req;
+		else upload_queue = req;
+		upload_queue_tail = req;
 	}
-	// create texture
+	return 0;
+}
+
+// orphan the upload PBO and map size bytes of it for writing; it is left bound to GL_PIXEL_UNPACK_BUFFER
+void* __map_texture_pbo(uint32_t size) {
+	if(!texture_pbo_id) glGenBuffers(1,&texture_pbo_id);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture_pbo_id);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+	return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void __free_texture_request(texture_request_t* req) {
+	for(uint32_t i = 0; i < req->n_levels; i++)
+		free(req->levels[i]);
+	for(uint32_t i = 0; i < TEXTURE_LAYER_LEVELS; i++)
+		free(req->layer_levels[i]);
+	free(req->path);
+	free(req);
+}
+
+// start a decoded texture: allocate its mip chain, and copy its texture array layer (which is small)
+void __start_texture_upload(texture_request_t* req) {
+	glBindTexture(GL_TEXTURE_2D, req->tbo_id);
+	for(uint32_t i = 0; i < req->n_levels; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, req->widths[i], req->heights[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, req->n_levels-1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, req->n_levels-1);
+	if(req->layer != MAX_TEXTURE_LAYERS) {
+		uint32_t size = 0;
+		for(uint32_t i = 0; i < TEXTURE_LAYER_LEVELS; i++)
+			size += (TEXTURE_LAYER_SIZE >> i) * (TEXTURE_LAYER_SIZE >> i) * 4;
+		uint8_t* dst = __map_texture_pbo(size);
+		for(uint32_t i = 0, offset = 0; i < TEXTURE_LAYER_LEVELS; i++) {
+			uint32_t level_size = (TEXTURE_LAYER_SIZE >> i) * (TEXTURE_LAYER_SIZE >> i) * 4;
+			memcpy(dst+offset, req->layer_levels[i], level_size);
+			offset += level_size;
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+		for(uint32_t i = 0, offset = 0; i < TEXTURE_LAYER_LEVELS; i++) {
+			uint32_t level_size = TEXTURE_LAYER_SIZE >> i;
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, req->layer, level_size, level_size, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, (void*)(uintptr_t)offset);
+			offset += level_size*level_size*4;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	req->started = 1;
+	req->level = req->n_levels-1;
+	req->row = 0;
+}
+
+// upload decoded textures, within TEXTURE_UPLOAD_BUDGET bytes; call once per frame
+void update_textures() {
+	int32_t budget = TEXTURE_UPLOAD_BUDGET;
+	while(budget > 0) {
+		if(!uploading) {
+			pthread_mutex_lock(&texture_lock);
+			uploading = upload_queue;
+			if(uploading) upload_queue = uploading->next;
+			if(!upload_queue) upload_queue_tail = 0;
+			pthread_mutex_unlock(&texture_lock);
+			if(!uploading) return;
+			if(uploading->failed) {
+				printf("error in update_textures: failed to load texture from file %s\n", uploading->path);
+				__free_texture_request(uploading);
+				uploading = 0;
+				continue;
+			}
+			__start_texture_upload(uploading);
+		}
+		texture_request_t* req = uploading;
+		uint32_t w = req->widths[req->level], h = req->heights[req->level];
+		uint32_t rows = budget / (w*4);
+		if(rows < 1) rows = 1;
+		if(rows > h - req->row) rows = h - req->row;
+		memcpy(__map_texture_pbo(rows*w*4), &req->levels[req->level][req->row*w*4], rows*w*4);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindTexture(GL_TEXTURE_2D, req->tbo_id);
+		glTexSubImage2D(GL_TEXTURE_2D, req->level, 0, req->row, w, rows, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		budget -= rows*w*4;
+		req->row += rows;
+		if(req->row < h) continue;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, req->level);	// level complete; sample it
+		req->row = 0;
+		if(req->level-- == 0) {
+			__free_texture_request(req);
+			uploading = 0;
+			textures_updated = 1;
+		}
+	}
+}
+
+// return the texture array layer + 1 for a texture, or 0 if it has none
+uint32_t texture_layer(GLuint texture) {
+	for(uint32_t i = 0; i < n_textures && i < MAX_TEXTURE_LAYERS; i++)
+		if(gl_textures[i] == texture) return i+1;
+	return 0;
+}
+
+// start loading a texture; it is usable (as a transparent placeholder) immediately. returns its ID.
+// decoding errors are reported once the loader gets to it, and leave the placeholder in place.
+GLuint load_texture_from_file(char* path) {
+	if(!texture_loaders_started) {
+		for(uint32_t i = 0; i < TEXTURE_LOADERS; i++)
+			if(pthread_create(&texture_loaders[i], 0, texture_loader_main, 0)) {
+				printf("internal error at load_texture_from_file: failed to create texture loader thread.\n");
+				exit(1);
+			}
+		texture_loaders_started = 1;
+	}
+	if(!texture_array_id) {
+		glGenTextures(1,&texture_array_id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+		for(uint32_t i = 0; i < TEXTURE_LAYER_LEVELS; i++)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, TEXTURE_LAYER_SIZE >> i, TEXTURE_LAYER_SIZE >> i, MAX_TEXTURE_LAYERS,
+				0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	// create the texture with a placeholder
 	GLuint tbo_id;
+	uint8_t placeholder[4] = { 0,0,0,0 };
 	glGenTextures(1,&tbo_id);
 	glBindTexture(GL_TEXTURE_2D, tbo_id);
-	// upload image to TBO
-	if(comp == 3)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	else if(comp == 4)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	// return created texture's ID (or 0 on failure)
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	uint32_t layer = n_textures < MAX_TEXTURE_LAYERS ? n_textures : MAX_TEXTURE_LAYERS;
+	if(layer != MAX_TEXTURE_LAYERS) {
+		uint8_t* texels = calloc(TEXTURE_LAYER_SIZE*TEXTURE_LAYER_SIZE, 4);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+		for(uint32_t i = 0; i < TEXTURE_LAYER_LEVELS; i++)
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, TEXTURE_LAYER_SIZE >> i, TEXTURE_LAYER_SIZE >> i, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, texels);
+		free(texels);
+	}
 	gl_textures = realloc(gl_textures, sizeof(GLuint)*(n_textures+1));
 	gl_textures[n_textures++] = tbo_id;
-	stbi_image_free(image);
+
+	texture_request_t* req = calloc(1,sizeof(texture_request_t));
+	req->path = strdup(path);
+	req->tbo_id = tbo_id;
+	req->layer = layer;
+	pthread_mutex_lock(&texture_lock);
+	if(decode_queue_tail) decode_queue_tail->next = req;
+	else decode_queue = req;
+	decode_queue_tail = req;
+	pthread_cond_signal(&texture_cond);
+	pthread_mutex_unlock(&texture_lock);
 	return tbo_id;
 }
 
@@ -221,23 +678,64 @@ typedef struct brick_t {
 	uint8_t repeat_textures[6];
 	uint8_t has_gravity, has_collision;
 	uint8_t deleted;
+	uint8_t is_dynamic;		// moved at runtime; never baked into a chunk
+	int32_t chunk_id;		// chunk this brick is baked into, -1 if drawn individually
+	vec3 bake_min, bake_max;	// AABB the brick was filed under in the chunk cell lists
 } brick_t;
 
+#define CHUNK_SIZE 16
+#define CELL_SIZE 4									// chunks are split into cells for neighbor queries
+#define CHUNK_CELLS (CHUNK_SIZE/CELL_SIZE)			// cells per chunk along each axis
+
+typedef struct chunk_t {
+	int32_t cx, cy, cz;		// chunk coordinates (world position / CHUNK_SIZE, rounded down)
+	uint32_t* brick_ids;	// static bricks baked into this chunk
+	uint32_t n_brick_ids;
+	uint32_t* cell_ids[CHUNK_CELLS*CHUNK_CELLS*CHUNK_CELLS];	// static bricks overlapping each cell
+	uint32_t n_cell_ids[CHUNK_CELLS*CHUNK_CELLS*CHUNK_CELLS];
+	vec3 min, max;			// bounds of the baked geometry
+	uint8_t dirty;			// needs to be rebaked before the next draw
+	pool_range_t geometry;	// in chunk_pool; 16-bit indices unless past 65536 vertices
+	pool_range_t proxy;		// far-field proxy (see bake_chunk_proxy)
+	float pos_step, tex_step;	// size of one unit of packed vertex positions and texture coordinates
+	uint8_t lod;			// CHUNK_LOD_*
+	uint32_t impostor_tile;	// impostor atlas tile + 1; 0 if none
+	vec3 impostor_dir;		// direction from the chunk to the camera when its impostor was captured
+	uint8_t impostor_valid;
+} chunk_t;
+
+typedef struct point_light_t {
+	vec3 pos;
+	vec3 color;
+	float radius;					// the light fades out to nothing at this distance
+	int32_t brick_id;				// lamp brick the light follows (from its center), or -1
+	uint8_t deleted;
+} point_light_t;
+
 typedef struct world_t {
 	brick_t* bricks;
 	uint32_t n_bricks;
 	collision_t* colls;
 	uint32_t n_colls;
+	point_light_t* lights;
+	uint32_t n_lights;
+	chunk_t* chunks;
+	uint32_t n_chunks;
+	int32_t* chunk_hash;	// open addressing table of chunk IDs (-1 = empty), keyed by chunk coordinates
+	uint32_t chunk_hash_size;
+	int32_t chunk_cy_min, chunk_cy_max;		// vertical range of chunk coordinates in use
 	char* name;
 } world_t;
 
 world_t* world;
+world_t* render_world;		// the render thread's copy: bricks and lights as of the last render packet, and chunks
 
 void init_world() {
 	char* name = "Test World";
 	world = calloc(1,sizeof(world_t));
 	world->name = calloc(1,sizeof(name)+1);
 	strcpy(world->name,name);
+	render_world = calloc(1,sizeof(world_t));
 }
 
 void add_brick(world_t* world, vec3 pos, vec4 quat, vec3 scale, vec4 color, uint32_t mesh_id,
@@ -256,9 +754,12 @@ void add_brick(world_t* world, vec3 pos, vec4 quat, vec3 scale, vec4 color, uint
 	new_brick.repeat_textures[1] = 1;
 	new_brick.repeat_textures[3] = 1;
 	new_brick.deleted = 0;
+	new_brick.is_dynamic = 0;
+	new_brick.chunk_id = -1;
 	world->bricks = realloc(world->bricks, sizeof(brick_t)*(world->n_bricks+1));
 	world->bricks[world->n_bricks++] = new_brick;
 	if(has_collision) add_brick_collider_aabb(world->n_bricks-1);
+	dirty_brick(world->n_bricks-1);
 }
 
 void delete_brick(uint32_t brick_id) {
@@ -266,12 +767,73 @@ void delete_brick(uint32_t brick_id) {
 		world->bricks[brick_id].deleted = 1;
 		for(uint32_t i = 0; i < world->n_colls; i++)
 			if(world->colls[i].brick_id == brick_id) world->colls[i].deleted = 1;
+		dirty_brick(brick_id);
 	}
 }
 
 void add_brick_texture(uint32_t brick_id, uint8_t face, GLuint texture, uint8_t repeat) {
 	world->bricks[brick_id].texture_ids[face] = texture;
 	world->bricks[brick_id].repeat_textures[face] = repeat;
+	dirty_brick(brick_id);
+}
+
+void set_brick_color(uint32_t brick_id, vec4 color) {
+	world->bricks[brick_id].color = color;
+	dirty_brick(brick_id);
+}
+
+// return the new light's ID
+uint32_t add_light(world_t* world, vec3 pos, vec3 color, float radius) {
+	point_light_t light = { pos, color, radius, -1, 0 };
+	world->lights = realloc(world->lights, sizeof(point_light_t)*(world->n_lights+1));
+	world->lights[world->n_lights] = light;
+	return world->n_lights++;
+}
+
+void delete_light(uint32_t light_id) {
+	world->lights[light_id].deleted = 1;
+}
+
+// make a brick a lamp; its light moves with it, and goes out if it is deleted. returns the light's ID
+uint32_t add_brick_light(uint32_t brick_id, vec3 color, float radius) {
+	uint32_t light_id = add_light(world, world->bricks[brick_id].pos, color, radius);
+	world->lights[light_id].brick_id = brick_id;
+	return light_id;
+}
+
+// a set of render_world brick IDs, so the bricks drawn one by one can be walked without visiting every brick
+typedef struct brick_list_t {
+	uint32_t* ids;
+	uint32_t n_ids, max_ids;
+	int32_t* slots;			// per brick; index in ids, or -1
+	uint32_t n_slots;
+} brick_list_t;
+
+brick_list_t loose_bricks;		// bricks not deleted or baked into a chunk (BRICK_RENDER_CHUNKS)
+brick_list_t unpulled_bricks;	// bricks not deleted or drawn through the pulling path (BRICK_RENDER_PULL)
+
+// add a brick to or remove it from a list
+void brick_list_set(brick_list_t* list, uint32_t brick_id, uint8_t member) {
+	if(list->n_slots <= brick_id) {
+		uint32_t n = render_world->n_bricks > brick_id ? render_world->n_bricks : brick_id+1;
+		list->slots = realloc(list->slots, sizeof(int32_t)*n);
+		memset(list->slots+list->n_slots, 0xff, sizeof(int32_t)*(n-list->n_slots));
+		list->n_slots = n;
+	}
+	int32_t slot = list->slots[brick_id];
+	if(member && slot == -1) {
+		if(list->n_ids == list->max_ids) {
+			list->max_ids = list->max_ids ? list->max_ids*2 : 256;
+			list->ids = realloc(list->ids, sizeof(uint32_t)*list->max_ids);
+		}
+		list->slots[brick_id] = list->n_ids;
+		list->ids[list->n_ids++] = brick_id;
+	} else if(!member && slot != -1) {
+		uint32_t last = list->ids[--list->n_ids];
+		list->ids[slot] = last;
+		list->slots[last] = slot;
+		list->slots[brick_id] = -1;
+	}
 }
 
 
@@ -451,7 +1013,12 @@ void physics_step() {
 			world->bricks[i].pos.y -= gravity_step;
 }
 
+// bricks moved through here are treated as dynamic from then on
 void translate_brick(int32_t brick_id, vec3 translation) {
+	if(!world->bricks[brick_id].is_dynamic) {
+		world->bricks[brick_id].is_dynamic = 1;
+		dirty_brick(brick_id);
+	}
 	brick_t brick = world->bricks[brick_id];
 	vec3 new_pos = __add_vec3(brick.pos,translation);
 	if(brick.has_collision) {
@@ -476,6 +1043,7 @@ void set_brick_pos(uint32_t brick_id, vec3 new_pos) {
 		for(uint32_t i = 0; i < world->n_colls; i++)
 			if(world->colls[i].brick_id == brick_id)
 				world->colls[i].pos = new_pos;
+	dirty_brick(brick_id);
 }
 
 void set_brick_scale(uint32_t brick_id, vec3 new_scale) {
@@ -484,6 +1052,7 @@ void set_brick_scale(uint32_t brick_id, vec3 new_scale) {
 		for(uint32_t i = 0; i < world->n_colls; i++)
 			if(world->colls[i].brick_id == brick_id)
 				world->colls[i].dim = new_scale;
+	dirty_brick(brick_id);
 }
 
 
@@ -558,6 +1127,18 @@ mat4 perspective(float fovy, float aspect, float near, float far) {
 	return m;
 }
 
+// calculate an orthographic projection matrix
+mat4 orthographic(float left, float right, float bottom, float top, float near, float far) {
+	mat4 m = identity();
+	m.m00 = 2/(right-left);
+	m.m11 = 2/(top-bottom);
+	m.m22 = -2/(far-near);
+	m.m03 = -(right+left)/(right-left);
+	m.m13 = -(top+bottom)/(top-bottom);
+	m.m23 = -(far+near)/(far-near);
+	return m;
+}
+
 float __dot_vec3(vec3 a, vec3 b) {
 	return a.x*b.x + a.y*b.y + a.z*b.z;
 }
@@ -615,6 +1196,29 @@ vec3 __scale_vec3(vec3 v, float s) {
 	return scaled;
 }
 
+// pack a color into RGBA8 (R in the low byte)
+uint32_t pack_color(vec4 c) {
+	return (uint32_t)roundf(fminf(fmaxf(c.x,0),1)*255) | (uint32_t)roundf(fminf(fmaxf(c.y,0),1)*255) << 8
+		| (uint32_t)roundf(fminf(fmaxf(c.z,0),1)*255) << 16 | (uint32_t)roundf(fminf(fmaxf(c.w,0),1)*255) << 24;
+}
+
+// convert a float to IEEE half precision (rounded to nearest)
+uint16_t float_to_half(float f) {
+	uint32_t x;
+	memcpy(&x,&f,4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t e = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+	uint32_t m = x & 0x7fffff;
+	if(e >= 31) return sign | 0x7c00;				// too large; infinity
+	if(e <= 0) {									// subnormal, or too small
+		if(e < -10) return sign;
+		m |= 0x800000;
+		uint32_t shift = 14-e;
+		return sign | ((m >> shift) + ((m >> (shift-1)) & 1));	// rounding up to the smallest normal is exact too
+	}
+	return sign | ((e << 10) + ((m + 0x1000) >> 13));	// a rounding carry correctly bumps the exponent
+}
+
 vec4 __mult_vec4(vec4 a, vec4 b) {
 	vec4 v = { a.x*b.x, a.y*b.y, a.z*b.z, a.w*b.w };
 	return v;
@@ -848,6 +1452,34 @@ void right(camera_t* cam, float units) {
 	}
 }
 
+// calculate a brick's model matrix (scale, then rotate, then translate)
+mat4 brick_model_matrix(brick_t* brick) {
+	mat4 smat = scale(brick->scale);
+	mat4 rmat = quat_to_mat4(brick->quat);
+	mat4 tmat = translate(brick->pos);
+	mat4 model = mat4_mat4(rmat,smat);
+	return mat4_mat4(tmat,model);
+}
+
+// calculate the world-space AABB of a brick using the default (unit cube) mesh
+void brick_aabb(brick_t* brick, vec3* min, vec3* max) {
+	if(brick->quat.x == 0 && brick->quat.y == 0 && brick->quat.z == 0) {	// not rotated
+		*min = brick->pos;
+		*max = __add_vec3(brick->pos, brick->scale);
+		return;
+	}
+	mat4 model = brick_model_matrix(brick);
+	vec3 bmin = { FLT_MAX,FLT_MAX,FLT_MAX }, bmax = { -FLT_MAX,-FLT_MAX,-FLT_MAX };
+	for(uint32_t i = 0; i < 8; i++) {
+		vec4 c = { i&1, (i>>1)&1, (i>>2)&1, 1 };
+		c = mat4_vec4(model, c);
+		bmin.x = fminf(bmin.x,c.x); bmin.y = fminf(bmin.y,c.y); bmin.z = fminf(bmin.z,c.z);
+		bmax.x = fmaxf(bmax.x,c.x); bmax.y = fmaxf(bmax.y,c.y); bmax.z = fmaxf(bmax.z,c.z);
+	}
+	*min = bmin;
+	*max = bmax;
+}
+
 /*==================================================*/
 /*				PLAYER CODE							*/
 /*==================================================*/
@@ -904,122 +1536,2991 @@ void translate_player(vec3 translation) {
 }
 
 
+// place the camera for this frame (orbiting the player entity unless in noclip) and return the view matrix
+mat4 update_camera() {
+	vec3 center = camera_center(player->camera);
+	vec3 up = { 0,1,0 };
+	if(!player->focused)
+		return look_at(player->camera.pos, center, up);
+
+	// eye vector should be 10 studs away from player position, in reverse of whichever direction the camera is facing.
+	player->camera.pos = entities[player->entity_id].pos;
+
+	// circle point around the player (XZ plane)
+	vec4 c4 = { 0,0,player->camera.zoom,1 };
+	mat4 rot_matrix = quat_to_mat4(player->camera.quat);
+	c4 = mat4_vec4(rot_matrix, c4);
+	vec3 c3 = { c4.x,c4.y,c4.z };
+	player->camera.pos = __add_vec3(player->camera.pos, c3);
+	player->camera.pos.y += 3;
+
+	center = camera_center(player->camera);
+	return look_at(player->camera.pos, center, up);
+}
+
 /*==================================================*/
-/*				RENDERING							*/
+/*				WORKER THREADS						*/
 /*==================================================*/
-// render as the global 'player' variable
-// a lot of the work was done in init_gl
-// shader and program setting, and mesh generation (mesh 0 is our brick)
+// a small fork-join pool: run_jobs() hands job indices out to the worker threads
+// and to the calling thread, and returns once every job has finished.
+// only one thread may call run_jobs() at a time.
+
+#define MAX_WORKERS 8
+
+typedef void (*job_fn_t)(void* arg, uint32_t job_idx);
+
+typedef struct job_pool_t {
+	pthread_t threads[MAX_WORKERS];
+	uint32_t n_threads;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond, done_cond;
+	job_fn_t fn;
+	void* arg;
+	uint32_t n_jobs, next_job, n_done;
+	uint32_t generation;		// incremented for every run_jobs() call
+} job_pool_t;
+
+job_pool_t job_pool;
+
+// run jobs until none are left to hand out; called with the pool lock held
+void __run_pending_jobs() {
+	while(job_pool.next_job < job_pool.n_jobs) {
+		uint32_t job_idx = job_pool.next_job++;
+		job_fn_t fn = job_pool.fn;
+		void* arg = job_pool.arg;
+		pthread_mutex_unlock(&job_pool.lock);
+		fn(arg, job_idx);
+		pthread_mutex_lock(&job_pool.lock);
+		if(++job_pool.n_done == job_pool.n_jobs)
+			pthread_cond_signal(&job_pool.done_cond);
+	}
+}
 
-// these are the main programs:
-// program_ids[0] - basic. reads only vec3 pos attribute; solid color (vtx_format >= 0).
-// program_ids[1] - reads vec3 pos and vec3 norm attributes (vtx_format >= 1).
+void* worker_main(void* unused) {
+	pthread_mutex_lock(&job_pool.lock);
+	uint32_t generation = job_pool.generation;
+	while(1) {
+		while(job_pool.generation == generation)
+			pthread_cond_wait(&job_pool.work_cond, &job_pool.lock);
+		generation = job_pool.generation;
+		__run_pending_jobs();
+	}
+	return 0;
+}
 
-GLuint* program_ids;
-uint32_t n_programs;
+void init_workers() {
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	job_pool.n_threads = n_cpus > 1 ? n_cpus-1 : 0;	// the calling thread runs jobs too
+	if(job_pool.n_threads > MAX_WORKERS) job_pool.n_threads = MAX_WORKERS;
+	pthread_mutex_init(&job_pool.lock, 0);
+	pthread_cond_init(&job_pool.work_cond, 0);
+	pthread_cond_init(&job_pool.done_cond, 0);
+	for(uint32_t i = 0; i < job_pool.n_threads; i++)
+		if(pthread_create(&job_pool.threads[i], 0, worker_main, 0)) {
+			printf("error in init_workers: failed to create worker thread, continuing with %u\n", i);
+			job_pool.n_threads = i;
+			break;
+		}
+}
 
-// create a new GL program
-GLuint create_program(const char* vtx_shader_src, const char* pxl_shader_src) {
-	GLuint vtx_shader = glCreateShader(GL_VERTEX_SHADER);
-	GLuint pxl_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(vtx_shader,1,&vtx_shader_src,0);
-	glShaderSource(pxl_shader,1,&pxl_shader_src,0);
-	glCompileShader(vtx_shader);
-	GLint success = 0;
-	glGetShaderiv(vtx_shader,GL_COMPILE_STATUS,&success);
-	if(!success) {
-		printf("failed to compile vertex shader.\n");
-		GLint max_length = 0;
-		glGetShaderiv(vtx_shader, GL_INFO_LOG_LENGTH, &max_length);
-		char* info_log = calloc(1,max_length);
-		glGetShaderInfoLog(vtx_shader, max_length, &max_length, &info_log[0]);
-		printf("%s\n", info_log);
-		exit(1);
+// call fn(arg, i) for i in 0..n_jobs-1 across the pool, and wait for all of them
+void run_jobs(job_fn_t fn, void* arg, uint32_t n_jobs) {
+	if(!n_jobs) return;
+	pthread_mutex_lock(&job_pool.lock);
+	job_pool.fn = fn;
+	job_pool.arg = arg;
+	job_pool.n_jobs = n_jobs;
+	job_pool.next_job = 0;
+	job_pool.n_done = 0;
+	job_pool.generation++;
+	pthread_cond_broadcast(&job_pool.work_cond);
+	__run_pending_jobs();
+	while(job_pool.n_done < job_pool.n_jobs)
+		pthread_cond_wait(&job_pool.done_cond, &job_pool.lock);
+	pthread_mutex_unlock(&job_pool.lock);
+}
+
+
+/*==================================================*/
+/*				OCCLUSION CULLING					*/
+/*==================================================*/
+// a low resolution software depth buffer. each frame the largest nearby opaque bricks
+// are rasterized into it (one job per horizontal band), then brick bounding boxes are
+// tested against it before any draw is submitted. no GPU readback is involved.
+// depth is stored as window-space z (0 = near plane, 1 = far plane); nearest occluder wins.
+
+#define OCC_W 256
+#define OCC_H 128
+#define OCC_BANDS 8
+#define OCC_MAX_OCCLUDERS 32
+#define OCC_MIN_SCORE 0.01			// minimum (surface area / distance^2) for a brick to occlude
+#define OCC_TEST_BATCH 256			// bricks tested per job
+
+typedef struct occ_tri_t {
+	float x[3], y[3], z[3];			// in occlusion buffer space
+} occ_tri_t;
+
+float occ_depth[OCC_W*OCC_H] __attribute__((aligned(16)));
+mat4 occ_view_proj;
+occ_tri_t* occ_tris;
+uint32_t n_occ_tris, max_occ_tris;
+uint8_t* brick_visibility;			// per brick; 1 if it passed the last occlusion_cull()
+uint32_t n_brick_visibility;
+
+// corners of the unit cube are indexed by bits (x | y<<1 | z<<2); two triangles per face
+const uint8_t occ_box_tris[36] = {
+	0,2,6, 0,6,4,	1,3,7, 1,7,5,	// -x, +x
+	0,1,5, 0,5,4,	2,3,7, 2,7,6,	// -y, +y
+	0,1,3, 0,3,2,	4,5,7, 4,7,6	// -z, +z
+};
+
+// clip a clip-space triangle against the near plane and add the result to occ_tris
+void __occ_add_tri(vec4 a, vec4 b, vec4 c) {
+	vec4 in[3] = { a,b,c }, poly[4];
+	uint32_t n_poly = 0;
+	for(uint32_t i = 0; i < 3; i++) {
+		vec4 p = in[i], q = in[(i+1)%3];
+		float dp = p.z + p.w, dq = q.z + q.w;		// >= 0 when in front of the near plane
+		if(dp >= 0) poly[n_poly++] = p;
+		if((dp >= 0) != (dq >= 0)) {
+			float t = dp / (dp - dq);
+			vec4 r = { p.x+(q.x-p.x)*t, p.y+(q.y-p.y)*t, p.z+(q.z-p.z)*t, p.w+(q.w-p.w)*t };
+			poly[n_poly++] = r;
+		}
 	}
-	glCompileShader(pxl_shader);
-	glGetShaderiv(pxl_shader,GL_COMPILE_STATUS,&success);
-	if(!success) {
-		printf("failed to compile pixel shader.\n");
-		GLint max_length = 0;
-		glGetShaderiv(pxl_shader, GL_INFO_LOG_LENGTH, &max_length);
-		char* info_log = calloc(1,max_length);
-		glGetShaderInfoLog(pxl_shader, max_length, &max_length, &info_log[0]);
-		printf("%s\n", info_log);
-		exit(1);
+	if(n_poly < 3) return;
+
+	float sx[4], sy[4], sz[4];
+	for(uint32_t i = 0; i < n_poly; i++) {
+		float inv_w = 1.0f / poly[i].w;
+		sx[i] = (poly[i].x*inv_w*.5f + .5f) * OCC_W;
+		sy[i] = (poly[i].y*inv_w*.5f + .5f) * OCC_H;
+		sz[i] = poly[i].z*inv_w*.5f + .5f;
 	}
-	program_ids = realloc(program_ids, sizeof(GLuint));
-	program_ids[n_programs] = glCreateProgram();
-	glAttachShader(program_ids[n_programs],vtx_shader);
-	glAttachShader(program_ids[n_programs],pxl_shader);
-	glLinkProgram(program_ids[n_programs]);
-	glGetProgramiv(program_ids[n_programs],GL_LINK_STATUS,&success);
-	if(!success) {
-		printf("failed to link shaders.\n");
-		exit(1);
+	for(uint32_t i = 1; i+1 < n_poly; i++) {		// fan triangulation
+		if(n_occ_tris == max_occ_tris) {
+			max_occ_tris = max_occ_tris ? max_occ_tris*2 : 256;
+			occ_tris = realloc(occ_tris, sizeof(occ_tri_t)*max_occ_tris);
+		}
+		occ_tri_t* tri = &occ_tris[n_occ_tris++];
+		uint32_t idx[3] = { 0, i, i+1 };
+		for(uint32_t j = 0; j < 3; j++)
+			tri->x[j] = sx[idx[j]], tri->y[j] = sy[idx[j]], tri->z[j] = sz[idx[j]];
 	}
-	glDetachShader(program_ids[n_programs], vtx_shader);
-	glDetachShader(program_ids[n_programs], pxl_shader);
-	n_programs++;
 }
 
-void init_render() {	// setup and set shader program, GL states
-	// setup depth test, blending
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void __occ_add_brick(brick_t* brick) {
+	mat4 mvp = mat4_mat4(occ_view_proj, brick_model_matrix(brick));
+	vec4 corners[8];
+	for(uint32_t i = 0; i < 8; i++) {
+		vec4 c = { i&1, (i>>1)&1, (i>>2)&1, 1 };
+		corners[i] = mat4_vec4(mvp, c);
+	}
+	for(uint32_t i = 0; i < 36; i += 3)
+		__occ_add_tri(corners[occ_box_tris[i]], corners[occ_box_tris[i+1]], corners[occ_box_tris[i+2]]);
+}
 
-	const char* vtx_shader_src_1 =
-	"#version 330										\n"
-	"layout(location=0) in vec3 vtx_pos;				\n"
-	"uniform mat4 u_model, u_view, u_proj;				\n"
-	"void main() {										\n"	
-	"	gl_Position = u_proj * u_view * u_model * vec4(vtx_pos,1);	\n"
-	"}													";
+// rasterize every occluder triangle into the rows of one band
+void __occ_raster_band(void* arg, uint32_t band) {
+	int32_t band_y0 = band * (OCC_H/OCC_BANDS);
+	int32_t band_y1 = band_y0 + (OCC_H/OCC_BANDS) - 1;
+	for(uint32_t i = band_y0*OCC_W; i < (band_y1+1)*OCC_W; i++)
+		occ_depth[i] = 1;
+
+	for(uint32_t t = 0; t < n_occ_tris; t++) {
+		occ_tri_t tri = occ_tris[t];
+		float area = (tri.x[1]-tri.x[0])*(tri.y[2]-tri.y[0]) - (tri.y[1]-tri.y[0])*(tri.x[2]-tri.x[0]);
+		if(area == 0) continue;
+		if(area < 0) {		// make the winding consistent so all edge functions are positive inside
+			float x = tri.x[1], y = tri.y[1], z = tri.z[1];
+			tri.x[1] = tri.x[2], tri.y[1] = tri.y[2], tri.z[1] = tri.z[2];
+			tri.x[2] = x, tri.y[2] = y, tri.z[2] = z;
+			area = -area;
+		}
+		int32_t x0 = floorf(fminf(fminf(tri.x[0],tri.x[1]),tri.x[2]));
+		int32_t x1 = ceilf(fmaxf(fmaxf(tri.x[0],tri.x[1]),tri.x[2]));
+		int32_t y0 = floorf(fminf(fminf(tri.y[0],tri.y[1]),tri.y[2]));
+		int32_t y1 = ceilf(fmaxf(fmaxf(tri.y[0],tri.y[1]),tri.y[2]));
+		if(x0 < 0) x0 = 0;
+		if(x1 > OCC_W-1) x1 = OCC_W-1;
+		if(y0 < band_y0) y0 = band_y0;
+		if(y1 > band_y1) y1 = band_y1;
+		if(x0 > x1 || y0 > y1) continue;
+
+		// edge functions e = a*x + b*y + c, and the depth plane z = zc + zx*x + zy*y
+		float ea[3], eb[3], ec[3];
+		for(uint32_t e = 0; e < 3; e++) {
+			uint32_t n = (e+1)%3;
+			ea[e] = tri.y[e] - tri.y[n];
+			eb[e] = tri.x[n] - tri.x[e];
+			ec[e] = -(ea[e]*tri.x[e] + eb[e]*tri.y[e]);
+		}
+		float zx = ((tri.z[1]-tri.z[0])*(tri.y[2]-tri.y[0]) - (tri.z[2]-tri.z[0])*(tri.y[1]-tri.y[0])) / area;
+		float zy = ((tri.z[2]-tri.z[0])*(tri.x[1]-tri.x[0]) - (tri.z[1]-tri.z[0])*(tri.x[2]-tri.x[0])) / area;
+		float zc = tri.z[0] - zx*tri.x[0] - zy*tri.y[0];
+
+		for(int32_t y = y0; y <= y1; y++) {
+			float py = y + .5f;
+			float* row = &occ_depth[y*OCC_W];
+#ifdef __SSE2__
+			__m128 lane_x = _mm_set_ps(3.5f, 2.5f, 1.5f, .5f);
+			__m128 zero = _mm_setzero_ps();
+			__m128 row_e0 = _mm_set1_ps(eb[0]*py + ec[0]);
+			__m128 row_e1 = _mm_set1_ps(eb[1]*py + ec[1]);
+			__m128 row_e2 = _mm_set1_ps(eb[2]*py + ec[2]);
+			__m128 row_z = _mm_set1_ps(zy*py + zc);
+			for(int32_t x = x0 & ~3; x <= x1; x += 4) {	// 4-wide groups stay inside the row
+				__m128 px = _mm_add_ps(_mm_set1_ps(x), lane_x);
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[0]), px), row_e0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[1]), px), row_e1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[2]), px), row_e2);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0,zero), _mm_cmpge_ps(e1,zero)), _mm_cmpge_ps(e2,zero));
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zx), px), row_z);
+				__m128 old = _mm_load_ps(row+x);
+				__m128 nearest = _mm_min_ps(old, z);
+				_mm_store_ps(row+x, _mm_or_ps(_mm_and_ps(inside,nearest), _mm_andnot_ps(inside,old)));
+			}
+#else
+			for(int32_t x = x0; x <= x1; x++) {
+				float px = x + .5f;
+				if(ea[0]*px + eb[0]*py + ec[0] < 0 || ea[1]*px + eb[1]*py + ec[1] < 0
+				|| ea[2]*px + eb[2]*py + ec[2] < 0) continue;
+				float z = zx*px + zy*py + zc;
+				if(z < row[x]) row[x] = z;
+			}
+#endif
+		}
+	}
+}
 
-	const char* pxl_shader_src_1 =
-	"#version 330										\n"
-	"layout(location=0) out vec4 final;					\n"
-	"uniform vec4 u_color;								\n"
-	"void main() {										\n"
-	"	final = u_color;\n"
-	"}													";
+// pick the occluders for this frame and rasterize them
+void occlusion_begin(mat4 view_proj, vec3 eye) {
+	occ_view_proj = view_proj;
+	n_occ_tris = 0;
+
+	// keep the OCC_MAX_OCCLUDERS best opaque bricks, scored by surface area over squared distance
+	uint32_t occluders[OCC_MAX_OCCLUDERS];
+	float scores[OCC_MAX_OCCLUDERS];
+	uint32_t n_occluders = 0;
+	for(uint32_t i = 0; i < render_world->n_bricks; i++) {
+		brick_t* brick = &render_world->bricks[i];
+		if(brick->deleted || brick->mesh_id || brick->color.w < 1) continue;
+		vec3 min, max;
+		brick_aabb(brick, &min, &max);
+		vec3 d = {		// eye to closest point on the AABB
+			fmaxf(fmaxf(min.x-eye.x, eye.x-max.x), 0),
+			fmaxf(fmaxf(min.y-eye.y, eye.y-max.y), 0),
+			fmaxf(fmaxf(min.z-eye.z, eye.z-max.z), 0)
+		};
+		float dist2 = __dot_vec3(d,d);
+		if(dist2 == 0 || dist2 > far*far) continue;		// eye inside, or out of range
+		vec3 s = brick->scale;
+		float score = (s.x*s.y + s.y*s.z + s.x*s.z) / fmaxf(dist2, 1);
+		if(score < OCC_MIN_SCORE) continue;
+		if(n_occluders == OCC_MAX_OCCLUDERS && score <= scores[n_occluders-1]) continue;
+		uint32_t j = n_occluders < OCC_MAX_OCCLUDERS ? n_occluders++ : n_occluders-1;
+		for(; j > 0 && scores[j-1] < score; j--) {		// insertion keeps the list sorted by score
+			scores[j] = scores[j-1];
+			occluders[j] = occluders[j-1];
+		}
+		scores[j] = score;
+		occluders[j] = i;
+	}
+	for(uint32_t i = 0; i < n_occluders; i++)
+		__occ_add_brick(&render_world->bricks[occluders[i]]);
 
-	create_program(vtx_shader_src_1, pxl_shader_src_1);
+	run_jobs(__occ_raster_band, 0, OCC_BANDS);
+}
 
-	const char* vtx_shader_src_2 =
-	"#version 330										\n"
-	"layout(location=0) in vec3 vtx_pos;				\n"
-	"layout(location=1) in vec3 vtx_norm;				\n"
-	"out vec3 pxl_norm;									\n"
-	"out vec3 pxl_pos;									\n"
-	"uniform mat4 u_model, u_view, u_proj;				\n"
-	"void main() {										\n"	
-	"	pxl_norm = mat3(transpose(inverse(u_model))) * vtx_norm;\n"
-	"	pxl_pos = vec3(u_model * vec4(vtx_pos,1.0));	\n"
-	"	gl_Position = u_proj * u_view * u_model * vec4(vtx_pos,1);\n"
-	"}													";
+// test an AABB against the occlusion buffer; returns 0 if it is hidden or outside the view
+uint8_t occlusion_test_aabb(vec3 min, vec3 max) {
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX, zmin = FLT_MAX;
+	uint8_t outside_all = 0x3f;		// one bit per clip plane
+	uint8_t crosses_near = 0;
+	for(uint32_t i = 0; i < 8; i++) {
+		vec4 c = { i&1 ? max.x : min.x, i&2 ? max.y : min.y, i&4 ? max.z : min.z, 1 };
+		c = mat4_vec4(occ_view_proj, c);
+		uint8_t outside = (c.x < -c.w) | (c.x > c.w)<<1 | (c.y < -c.w)<<2 | (c.y > c.w)<<3
+			| (c.z < -c.w)<<4 | (c.z > c.w)<<5;
+		outside_all &= outside;
+		if(c.z < -c.w) { crosses_near = 1; continue; }
+		float inv_w = 1.0f / c.w;
+		float sx = (c.x*inv_w*.5f + .5f) * OCC_W;
+		float sy = (c.y*inv_w*.5f + .5f) * OCC_H;
+		x0 = fminf(x0,sx); x1 = fmaxf(x1,sx);
+		y0 = fminf(y0,sy); y1 = fmaxf(y1,sy);
+		zmin = fminf(zmin, c.z*inv_w*.5f + .5f);
+	}
+	if(outside_all) return 0;		// every corner outside the same frustum plane
+	if(crosses_near) return 1;
+
+	// expand by a pixel so occluder edges (rasterized at pixel centers) can't over-cover
+	int32_t ix0 = floorf(x0) - 1, ix1 = ceilf(x1) + 1;
+	int32_t iy0 = floorf(y0) - 1, iy1 = ceilf(y1) + 1;
+	if(ix0 < 0) ix0 = 0;
+	if(iy0 < 0) iy0 = 0;
+	if(ix1 > OCC_W-1) ix1 = OCC_W-1;
+	if(iy1 > OCC_H-1) iy1 = OCC_H-1;
+	if(ix0 > ix1 || iy0 > iy1) return 0;
+
+	for(int32_t y = iy0; y <= iy1; y++) {
+		float* row = &occ_depth[y*OCC_W];
+#ifdef __SSE2__
+		__m128 z = _mm_set1_ps(zmin);
+		__m128 lane_x = _mm_set_ps(3, 2, 1, 0);
+		__m128 lo = _mm_set1_ps(ix0), hi = _mm_set1_ps(ix1);
+		for(int32_t x = ix0 & ~3; x <= ix1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps(x), lane_x);
+			__m128 in_range = _mm_and_ps(_mm_cmpge_ps(px,lo), _mm_cmple_ps(px,hi));
+			__m128 behind = _mm_cmpge_ps(_mm_load_ps(row+x), z);	// occluder depth not in front of the box
+			if(_mm_movemask_ps(_mm_and_ps(in_range,behind))) return 1;
+		}
+#else
+		for(int32_t x = ix0; x <= ix1; x++)
+			if(row[x] >= zmin) return 1;
+#endif
+	}
+	return 0;
+}
 
-	const char* pxl_shader_src_2 =
-	"#version 330										\n"
-	"layout(location=0) out vec4 final;					\n"
-	"in vec3 pxl_norm;									\n"
-	"in vec3 pxl_pos;									\n"
-	"uniform vec4 u_color;								\n"
-	"void main() {										\n"
-	"	vec3 light_pos = vec3(75,50,50);				\n"
-	"	vec3 light_col = vec3(.6,.6,.6);				\n"
-	"	vec3 norm = normalize(pxl_norm);				\n"	
-	//"	vec3 light_dir = normalize(light_pos - pxl_pos);\n"			// from light position to object (point light)
-	"	vec3 light_dir = normalize(-vec3(-0.2f, -1.0f, -1.5f));\n"	// directional light
-	"	float diff = max(dot(norm, light_dir), 0.0);	\n"
-	"	vec3 diffuse = diff * light_col;				\n"
-	"	vec3 ambient = vec3(.6,.6,.6);					\n"
-	"	final = vec4(ambient+diffuse,1) * u_color;\n"
-	"}													";
+// arg is the brick_list_t to test, or 0 for every brick
+void __occ_test_bricks(void* arg, uint32_t job_idx) {
+	brick_list_t* list = arg;
+	uint32_t end = (job_idx+1) * OCC_TEST_BATCH, n = list ? list->n_ids : render_world->n_bricks;
+	if(end > n) end = n;
+	for(uint32_t j = job_idx * OCC_TEST_BATCH; j < end; j++) {
+		uint32_t i = list ? list->ids[j] : j;
+		brick_t* brick = &render_world->bricks[i];
+		if(brick->deleted) continue;
+		if(brick->chunk_id != -1 && brick_render_mode == BRICK_RENDER_CHUNKS) {		// baked; culled per chunk instead
+			brick_visibility[i] = 0;
+			continue;
+		}
+		if(brick->mesh_id) {		// bounds only known for the default mesh
+			brick_visibility[i] = 1;
+			continue;
+		}
+		if(gpu_culls_brick(i)) continue;
+		vec3 min, max;
+		brick_aabb(brick, &min, &max);
+		brick_visibility[i] = occlusion_test_aabb(min, max);
+	}
+}
 
-	create_program(vtx_shader_src_2, pxl_shader_src_2);
+// rasterize occluders for this view and fill brick_visibility for the bricks drawn one by one, and
+// for the pulled bricks when they aren't culled on the GPU
+void occlusion_cull(mat4 view_proj, vec3 eye) {
+	occlusion_begin(view_proj, eye);
+	if(n_brick_visibility < render_world->n_bricks) {
+		n_brick_visibility = render_world->n_bricks;
+		brick_visibility = realloc(brick_visibility, n_brick_visibility);
+	}
+	brick_list_t* list = brick_render_mode == BRICK_RENDER_CHUNKS ? &loose_bricks
+		: gpu_culls_pulled_bricks() ? &unpulled_bricks : 0;
+	uint32_t n = list ? list->n_ids : render_world->n_bricks;
+	run_jobs(__occ_test_bricks, list, (n + OCC_TEST_BATCH-1) / OCC_TEST_BATCH);
+}
 
-	const char* vtx_shader_src_3 =
+
+/*==================================================*/
+/*				CHUNKS								*/
+/*==================================================*/
+// static default-mesh bricks are baked into one shared vertex/index buffer per CHUNK_SIZE^3
+// region of the world, with transforms, colors and texture layers applied on the CPU.
+// a chunk is only rebaked after an edit marks it dirty (see refile_brick); bricks that move
+// (gravity, translate_brick) or use other meshes are still drawn one by one in render().
+// bricks belong to the chunk containing their position, so a chunk's bounds may extend past its region.
+// every static brick is also listed in each CELL_SIZE^3 cell its AABB touches, so faces fully
+// covered by an opaque neighbor (possibly in another chunk) can be left out of the bake.
+// each corner of a remaining face of an axis-aligned brick gets an ambient occlusion level (0-3) from
+// the opaque bricks just outside it (the two sides and the diagonal past the corner), like voxel AO.
+// faces are first split around the bricks in front of them, so the occlusion follows their footprints.
+// the remaining faces are greedily merged into larger quads where they share a plane and material,
+// and their occlusion does not vary along the direction of the merge.
+// each chunk also gets a coarse untextured proxy mesh, drawn instead when it is far away.
+// baked geometry is uploaded packed into 16-byte vertices (packed_chunk_vertex_t), with 16-bit
+// indices where a mesh has few enough vertices.
+
+#define CHUNK_REBUILDS_PER_FRAME 16
+#define FACE_EPS 1e-4f				// tolerance for bricks to count as touching
+#define MAX_FACE_COVERS 64			// faces touching more opaque neighbors than this are always kept
+#define PROXY_CELLS 4				// proxy boxes per axis of a chunk's bounds
+#define CHUNK_POS_STEP (1.0f/4096)	// finest position step of packed chunk vertices
+#define CHUNK_TEX_STEP (1.0f/1024)	// finest texture coordinate step
+#define AO_REACH .5f				// how far past a face corner bricks occlude it
+
+typedef struct chunk_vertex_t {
+	float pos[3];
+	float norm[3];
+	float tex[2];
+	uint8_t color[4];
+	uint8_t layer;			// texture array layer + 1; 0 if untextured
+	uint8_t ao;				// ambient occlusion level, 0 (open) to 3
+	uint8_t pad[2];
+} chunk_vertex_t;
+
+// the GPU layout of chunk_vertex_t. positions are fixed point, in steps of the chunk's pos_step from
+// the center of its region; normals are octahedral-encoded. texture coordinates of each quad are
+// shifted by whole repeats to start at 0 (textures wrap), then stored in steps of the chunk's tex_step.
+// baked bricks are opaque, so the alpha of the color is left out.
+typedef struct packed_chunk_vertex_t {
+	int16_t pos[3];
+	int8_t norm[2];
+	uint16_t tex[2];
+	uint8_t color[3];
+	uint8_t layer;			// layer in the low 6 bits, ao in the top 2
+} packed_chunk_vertex_t;
+
+// growable CPU-side geometry for a chunk being baked
+typedef struct chunk_mesh_t {
+	chunk_vertex_t* vtx;
+	uint32_t n_vtx, max_vtx;
+	uint32_t* idx;
+	uint32_t n_idx, max_idx;
+} chunk_mesh_t;
+
+chunk_mesh_t bake_mesh;		// reused between bakes
+
+// can this brick be baked into a chunk? (transparent bricks are drawn sorted, by render_loose_bricks)
+uint8_t brick_is_static(brick_t* brick) {
+	if(brick->deleted || brick->is_dynamic || brick->has_gravity || brick->mesh_id || brick->color.w < 1) return 0;
+	for(uint32_t f = 0; f < 6; f++)
+		if(brick->texture_ids[f] && !texture_layer(brick->texture_ids[f])) return 0;
+	return 1;
+}
+
+int32_t floor_div(int32_t a, int32_t b) {
+	return a >= 0 ? a/b : -((-a+b-1)/b);
+}
+
+uint32_t __chunk_hash(int32_t cx, int32_t cy, int32_t cz) {
+	return ((uint32_t)cx*73856093u ^ (uint32_t)cy*19349663u ^ (uint32_t)cz*83492791u) & (render_world->chunk_hash_size-1);
+}
+
+// return the ID of the chunk at some chunk coordinates, or -1 if it doesn't exist
+int32_t find_chunk(int32_t cx, int32_t cy, int32_t cz) {
+	if(!render_world->chunk_hash_size) return -1;
+	for(uint32_t h = __chunk_hash(cx,cy,cz);; h = (h+1) & (render_world->chunk_hash_size-1)) {
+		int32_t id = render_world->chunk_hash[h];
+		if(id == -1) return -1;
+		if(render_world->chunks[id].cx == cx && render_world->chunks[id].cy == cy && render_world->chunks[id].cz == cz)
+			return id;
+	}
+}
+
+// return the ID of the chunk at some chunk coordinates, creating it if it doesn't exist
+uint32_t get_chunk(int32_t cx, int32_t cy, int32_t cz) {
+	int32_t id = find_chunk(cx,cy,cz);
+	if(id != -1) return id;
+
+	chunk_t new_chunk;
+	memset(&new_chunk,0,sizeof(chunk_t));
+	new_chunk.cx = cx;
+	new_chunk.cy = cy;
+	new_chunk.cz = cz;
+	render_world->chunks = realloc(render_world->chunks, sizeof(chunk_t)*(render_world->n_chunks+1));
+	render_world->chunks[render_world->n_chunks++] = new_chunk;
+	if(render_world->n_chunks == 1) render_world->chunk_cy_min = render_world->chunk_cy_max = cy;
+	render_world->chunk_cy_min = cy < render_world->chunk_cy_min ? cy : render_world->chunk_cy_min;
+	render_world->chunk_cy_max = cy > render_world->chunk_cy_max ? cy : render_world->chunk_cy_max;
+
+	if(render_world->n_chunks*2 > render_world->chunk_hash_size) {	// grow and rehash, keeping the load under 1/2
+		render_world->chunk_hash_size = render_world->chunk_hash_size ? render_world->chunk_hash_size*2 : 64;
+		render_world->chunk_hash = realloc(render_world->chunk_hash, sizeof(int32_t)*render_world->chunk_hash_size);
+		memset(render_world->chunk_hash, 0xff, sizeof(int32_t)*render_world->chunk_hash_size);
+		for(uint32_t i = 0; i < render_world->n_chunks; i++) {
+			uint32_t h = __chunk_hash(render_world->chunks[i].cx, render_world->chunks[i].cy, render_world->chunks[i].cz);
+			while(render_world->chunk_hash[h] != -1) h = (h+1) & (render_world->chunk_hash_size-1);
+			render_world->chunk_hash[h] = i;
+		}
+	} else {
+		uint32_t h = __chunk_hash(cx,cy,cz);
+		while(render_world->chunk_hash[h] != -1) h = (h+1) & (render_world->chunk_hash_size-1);
+		render_world->chunk_hash[h] = render_world->n_chunks-1;
+	}
+	return render_world->n_chunks-1;
+}
+
+// add (add = 1) or remove a brick ID in the lists of every cell touched by an AABB
+void __file_brick_cells(uint32_t brick_id, vec3 min, vec3 max, uint8_t add) {
+	int32_t x0 = floorf(min.x/CELL_SIZE), x1 = floorf(max.x/CELL_SIZE);
+	int32_t y0 = floorf(min.y/CELL_SIZE), y1 = floorf(max.y/CELL_SIZE);
+	int32_t z0 = floorf(min.z/CELL_SIZE), z1 = floorf(max.z/CELL_SIZE);
+	for(int32_t x = x0; x <= x1; x++)
+	for(int32_t y = y0; y <= y1; y++)
+	for(int32_t z = z0; z <= z1; z++) {
+		int32_t cx = floor_div(x,CHUNK_CELLS), cy = floor_div(y,CHUNK_CELLS), cz = floor_div(z,CHUNK_CELLS);
+		int32_t chunk_id = add ? (int32_t)get_chunk(cx,cy,cz) : find_chunk(cx,cy,cz);
+		if(chunk_id == -1) continue;
+		chunk_t* chunk = &render_world->chunks[chunk_id];
+		uint32_t cell = ((x-cx*CHUNK_CELLS)*CHUNK_CELLS + (y-cy*CHUNK_CELLS))*CHUNK_CELLS + (z-cz*CHUNK_CELLS);
+		if(add) {
+			chunk->cell_ids[cell] = realloc(chunk->cell_ids[cell], sizeof(uint32_t)*(chunk->n_cell_ids[cell]+1));
+			chunk->cell_ids[cell][chunk->n_cell_ids[cell]++] = brick_id;
+		} else for(uint32_t i = 0; i < chunk->n_cell_ids[cell]; i++)
+			if(chunk->cell_ids[cell][i] == brick_id) {
+				chunk->cell_ids[cell][i] = chunk->cell_ids[cell][--chunk->n_cell_ids[cell]];
+				break;
+			}
+	}
+}
+
+uint32_t* query_ids;			// results of query_static_bricks
+uint32_t max_query_ids;
+uint32_t* query_stamps;			// per brick; equal to query_stamp if already in the current results
+uint32_t n_query_stamps, query_stamp;
+
+// find the static bricks whose AABB touches a box; returns the count, IDs are in query_ids
+uint32_t query_static_bricks(vec3 min, vec3 max) {
+	if(n_query_stamps < render_world->n_bricks) {
+		query_stamps = realloc(query_stamps, sizeof(uint32_t)*render_world->n_bricks);
+		memset(query_stamps+n_query_stamps, 0, sizeof(uint32_t)*(render_world->n_bricks-n_query_stamps));
+		n_query_stamps = render_world->n_bricks;
+	}
+	query_stamp++;
+	uint32_t n_ids = 0;
+	int32_t x0 = floorf(min.x/CELL_SIZE), x1 = floorf(max.x/CELL_SIZE);
+	int32_t y0 = floorf(min.y/CELL_SIZE), y1 = floorf(max.y/CELL_SIZE);
+	int32_t z0 = floorf(min.z/CELL_SIZE), z1 = floorf(max.z/CELL_SIZE);
+	for(int32_t x = x0; x <= x1; x++)
+	for(int32_t y = y0; y <= y1; y++)
+	for(int32_t z = z0; z <= z1; z++) {
+		int32_t cx = floor_div(x,CHUNK_CELLS), cy = floor_div(y,CHUNK_CELLS), cz = floor_div(z,CHUNK_CELLS);
+		int32_t chunk_id = find_chunk(cx,cy,cz);
+		if(chunk_id == -1) continue;
+		chunk_t* chunk = &render_world->chunks[chunk_id];
+		uint32_t cell = ((x-cx*CHUNK_CELLS)*CHUNK_CELLS + (y-cy*CHUNK_CELLS))*CHUNK_CELLS + (z-cz*CHUNK_CELLS);
+		for(uint32_t i = 0; i < chunk->n_cell_ids[cell]; i++) {
+			uint32_t id = chunk->cell_ids[cell][i];
+			if(query_stamps[id] == query_stamp) continue;
+			query_stamps[id] = query_stamp;
+			brick_t* brick = &render_world->bricks[id];
+			if(brick->bake_min.x > max.x || brick->bake_max.x < min.x
+			|| brick->bake_min.y > max.y || brick->bake_max.y < min.y
+			|| brick->bake_min.z > max.z || brick->bake_max.z < min.z) continue;
+			if(n_ids == max_query_ids) {
+				max_query_ids = max_query_ids ? max_query_ids*2 : 256;
+				query_ids = realloc(query_ids, sizeof(uint32_t)*max_query_ids);
+			}
+			query_ids[n_ids++] = id;
+		}
+	}
+	return n_ids;
+}
+
+// mark dirty every chunk owning a static brick within AO_REACH of a box (their hidden faces or
+// ambient occlusion may change)
+void __dirty_neighbors(vec3 min, vec3 max) {
+	vec3 eps = { AO_REACH,AO_REACH,AO_REACH };
+	uint32_t n_ids = query_static_bricks(__sub_vec3(min,eps), __add_vec3(max,eps));
+	for(uint32_t i = 0; i < n_ids; i++)
+		render_world->chunks[render_world->bricks[query_ids[i]].chunk_id].dirty = 1;
+}
+
+void chunk_add_brick(uint32_t brick_id) {
+	brick_t* brick = &render_world->bricks[brick_id];
+	uint32_t chunk_id = get_chunk(floorf(brick->pos.x/CHUNK_SIZE), floorf(brick->pos.y/CHUNK_SIZE),
+		floorf(brick->pos.z/CHUNK_SIZE));
+	chunk_t* chunk = &render_world->chunks[chunk_id];
+	chunk->brick_ids = realloc(chunk->brick_ids, sizeof(uint32_t)*(chunk->n_brick_ids+1));
+	chunk->brick_ids[chunk->n_brick_ids++] = brick_id;
+	chunk->dirty = 1;
+	brick->chunk_id = chunk_id;
+	brick_aabb(brick, &brick->bake_min, &brick->bake_max);
+	__file_brick_cells(brick_id, brick->bake_min, brick->bake_max, 1);
+	__dirty_neighbors(brick->bake_min, brick->bake_max);
+	minimap_mark_dirty(brick->bake_min, brick->bake_max);
+}
+
+void chunk_remove_brick(uint32_t brick_id) {
+	brick_t* brick = &render_world->bricks[brick_id];
+	if(brick->chunk_id == -1) return;
+	chunk_t* chunk = &render_world->chunks[brick->chunk_id];
+	for(uint32_t i = 0; i < chunk->n_brick_ids; i++)
+		if(chunk->brick_ids[i] == brick_id) {
+			chunk->brick_ids[i] = chunk->brick_ids[--chunk->n_brick_ids];
+			break;
+		}
+	chunk->dirty = 1;
+	__file_brick_cells(brick_id, brick->bake_min, brick->bake_max, 0);
+	__dirty_neighbors(brick->bake_min, brick->bake_max);
+	minimap_mark_dirty(brick->bake_min, brick->bake_max);
+	brick->chunk_id = -1;
+}
+
+// call after a brick is added or edited in render_world; moves it into (or out of) the right chunk
+// and marks it dirty
+void refile_brick(uint32_t brick_id) {
+	pull_mark_dirty(brick_id);
+	chunk_remove_brick(brick_id);
+	brick_t* brick = &render_world->bricks[brick_id];
+	if(brick_is_static(brick))
+		chunk_add_brick(brick_id);
+	brick_list_set(&loose_bricks, brick_id, !brick->deleted && brick->chunk_id == -1);
+}
+
+// is the brick's rotation a multiple of 90 degrees about every axis (so its AABB is exact)?
+uint8_t brick_is_axis_aligned(brick_t* brick) {
+	mat4 r = quat_to_mat4(brick->quat);
+	float m[9] = { r.m00, r.m01, r.m02, r.m10, r.m11, r.m12, r.m20, r.m21, r.m22 };
+	for(uint32_t i = 0; i < 9; i++)
+		if(fabsf(m[i]) > FACE_EPS && fabsf(fabsf(m[i])-1) > FACE_EPS) return 0;
+	return 1;
+}
+
+// can this static brick hide the faces of its neighbors?
+uint8_t brick_is_occluder(brick_t* brick) {
+	return brick->color.w >= 1 && brick_is_axis_aligned(brick);
+}
+
+int __compare_floats(const void* a, const void* b) {
+	float fa = *(const float*)a, fb = *(const float*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+// is a face of an axis-aligned brick completely covered by opaque neighbors?
+// axis is 0-2 (x,y,z) and side is +1 or -1. exact: coverage by several neighbors is checked
+// by splitting the face at every neighbor edge and testing each resulting cell.
+uint8_t face_hidden(uint32_t brick_id, uint32_t axis, int32_t side) {
+	brick_t* brick = &render_world->bricks[brick_id];
+	uint32_t ua = (axis+1)%3, va = (axis+2)%3;
+	float* bmin = &brick->bake_min.x;
+	float* bmax = &brick->bake_max.x;
+	float plane = side > 0 ? bmax[axis] : bmin[axis];
+
+	vec3 qmin = brick->bake_min, qmax = brick->bake_max;
+	(&qmin.x)[axis] = plane - FACE_EPS;
+	(&qmax.x)[axis] = plane + FACE_EPS;
+	uint32_t n_ids = query_static_bricks(qmin, qmax);
+
+	float covers[MAX_FACE_COVERS][4];	// u0, u1, v0, v1 of each neighbor, clipped to the face
+	uint32_t n_covers = 0;
+	for(uint32_t i = 0; i < n_ids; i++) {
+		if(query_ids[i] == brick_id) continue;
+		brick_t* other = &render_world->bricks[query_ids[i]];
+		if(!brick_is_occluder(other)) continue;
+		float* omin = &other->bake_min.x;
+		float* omax = &other->bake_max.x;
+		// the neighbor must fill the space just outside the face
+		if(side > 0 && !(omin[axis] <= plane+FACE_EPS && omax[axis] > plane+FACE_EPS)) continue;
+		if(side < 0 && !(omax[axis] >= plane-FACE_EPS && omin[axis] < plane-FACE_EPS)) continue;
+		float u0 = fmaxf(omin[ua],bmin[ua]), u1 = fminf(omax[ua],bmax[ua]);
+		float v0 = fmaxf(omin[va],bmin[va]), v1 = fminf(omax[va],bmax[va]);
+		if(u1-u0 <= FACE_EPS || v1-v0 <= FACE_EPS) continue;
+		if(u0 <= bmin[ua]+FACE_EPS && u1 >= bmax[ua]-FACE_EPS && v0 <= bmin[va]+FACE_EPS && v1 >= bmax[va]-FACE_EPS)
+			return 1;		// a single neighbor covers the whole face
+		if(n_covers == MAX_FACE_COVERS) return 0;
+		covers[n_covers][0] = u0, covers[n_covers][1] = u1;
+		covers[n_covers][2] = v0, covers[n_covers][3] = v1;
+		n_covers++;
+	}
+	if(!n_covers) return 0;
+
+	// split the face along every neighbor edge; each cell must lie inside some neighbor
+	float us[MAX_FACE_COVERS*2+2], vs[MAX_FACE_COVERS*2+2];
+	uint32_t n_us = 0, n_vs = 0;
+	us[n_us++] = bmin[ua], us[n_us++] = bmax[ua];
+	vs[n_vs++] = bmin[va], vs[n_vs++] = bmax[va];
+	for(uint32_t i = 0; i < n_covers; i++) {
+		us[n_us++] = covers[i][0], us[n_us++] = covers[i][1];
+		vs[n_vs++] = covers[i][2], vs[n_vs++] = covers[i][3];
+	}
+	qsort(us, n_us, sizeof(float), __compare_floats);
+	qsort(vs, n_vs, sizeof(float), __compare_floats);
+	for(uint32_t i = 0; i+1 < n_us; i++) {
+		if(us[i+1]-us[i] <= FACE_EPS) continue;
+		float mu = (us[i]+us[i+1])*.5f;
+		for(uint32_t j = 0; j+1 < n_vs; j++) {
+			if(vs[j+1]-vs[j] <= FACE_EPS) continue;
+			float mv = (vs[j]+vs[j+1])*.5f;
+			uint8_t covered = 0;
+			for(uint32_t k = 0; k < n_covers && !covered; k++)
+				covered = mu >= covers[k][0] && mu <= covers[k][1] && mv >= covers[k][2] && mv <= covers[k][3];
+			if(!covered) return 0;
+		}
+	}
+	return 1;
+}
+
+// append a quad (4 vertices in cube face order, indexed 0 1 2 2 1 3)
+void push_chunk_quad(chunk_mesh_t* mesh, chunk_vertex_t* quad) {
+	if(mesh->n_vtx+4 > mesh->max_vtx) {
+		mesh->max_vtx = mesh->max_vtx ? mesh->max_vtx*2 : 1024;
+		mesh->vtx = realloc(mesh->vtx, sizeof(chunk_vertex_t)*mesh->max_vtx);
+	}
+	if(mesh->n_idx+6 > mesh->max_idx) {
+		mesh->max_idx = mesh->max_idx ? mesh->max_idx*2 : 1536;
+		mesh->idx = realloc(mesh->idx, sizeof(uint32_t)*mesh->max_idx);
+	}
+	const uint32_t order[] = { 0,1,2, 2,1,3 };
+	for(uint32_t i = 0; i < 6; i++)
+		mesh->idx[mesh->n_idx++] = mesh->n_vtx + order[i];
+	for(uint32_t i = 0; i < 4; i++)
+		mesh->vtx[mesh->n_vtx++] = quad[i];
+}
+
+// build the 4 baked vertices of one face of a brick
+// (texture coordinates are scaled the same way program 2's vertex shader does it)
+void bake_brick_face(brick_t* brick, mat4* model, mat4* rot, uint32_t face, chunk_vertex_t* quad) {
+	uint8_t repeat = brick->texture_ids[face] && brick->repeat_textures[face];
+	uint8_t layer = texture_layer(brick->texture_ids[face]);
+	for(uint32_t k = 0; k < 4; k++) {
+		const float* v = &cube_vbo_data[(face*4+k)*8];
+		chunk_vertex_t* out = &quad[k];
+		vec4 p = { v[0], v[1], v[2], 1 };
+		p = mat4_vec4(*model, p);
+		vec4 n = { v[3]/brick->scale.x, v[4]/brick->scale.y, v[5]/brick->scale.z, 0 };
+		n = mat4_vec4(*rot, n);
+		vec3 n3 = __normalize_vec3((vec3){ n.x, n.y, n.z });
+		out->pos[0] = p.x, out->pos[1] = p.y, out->pos[2] = p.z;
+		out->norm[0] = n3.x, out->norm[1] = n3.y, out->norm[2] = n3.z;
+		out->tex[0] = v[6], out->tex[1] = v[7];
+		if((face == 1 || face == 3) && repeat) out->tex[0] *= model->m22, out->tex[1] *= model->m00;
+		if((face == 4 || face == 5) && repeat) out->tex[0] *= model->m11, out->tex[1] *= model->m22;
+		if(face == 0) out->tex[0] *= model->m11, out->tex[1] *= model->m00;
+		if(face == 2) out->tex[0] *= model->m00, out->tex[1] *= model->m11;
+		out->color[0] = roundf(fminf(fmaxf(brick->color.x,0),1)*255);
+		out->color[1] = roundf(fminf(fmaxf(brick->color.y,0),1)*255);
+		out->color[2] = roundf(fminf(fmaxf(brick->color.z,0),1)*255);
+		out->color[3] = roundf(fminf(fmaxf(brick->color.w,0),1)*255);
+		out->layer = layer;
+		out->ao = 0;
+		out->pad[0] = out->pad[1] = 0;
+	}
+}
+
+// a visible face of an axis-aligned brick, as a rectangle on an axis plane, waiting to be merged
+typedef struct bake_face_t {
+	uint8_t axis, side;			// side is 1 for the +axis face, 0 for -axis
+	float plane;				// position of the face along its axis
+	float u0, u1, v0, v1;		// extent along axes (axis+1)%3 and (axis+2)%3
+	float tex_map[2][3];		// tex[i] = tex_map[i][0]*u + tex_map[i][1]*v + tex_map[i][2]
+	uint16_t tex_phase[2];		// fractional part of tex_map[i][2] in 1/1024ths; 0 if untextured
+	float norm[3];
+	uint8_t color[4];
+	uint8_t layer;
+	uint8_t ao[4];				// occlusion of corners (u0,v0), (u1,v0), (u0,v1), (u1,v1)
+	uint8_t merged;				// absorbed into another face
+} bake_face_t;
+
+bake_face_t* bake_faces;		// reused between bakes
+uint32_t n_bake_faces, max_bake_faces;
+
+bake_face_t* __new_bake_face() {
+	if(n_bake_faces == max_bake_faces) {
+		max_bake_faces = max_bake_faces ? max_bake_faces*2 : 1024;
+		bake_faces = realloc(bake_faces, sizeof(bake_face_t)*max_bake_faces);
+	}
+	bake_face_t* face = &bake_faces[n_bake_faces++];
+	memset(face,0,sizeof(bake_face_t));
+	return face;
+}
+
+// convert a baked quad of an axis-aligned brick into a bake_face_t
+void add_bake_face(chunk_vertex_t* quad, uint32_t axis, int32_t side) {
+	bake_face_t* face = __new_bake_face();
+	uint32_t ua = (axis+1)%3, va = (axis+2)%3;
+	face->axis = axis;
+	face->side = side > 0;
+	face->plane = quad[0].pos[axis];
+	face->u0 = face->v0 = FLT_MAX;
+	face->u1 = face->v1 = -FLT_MAX;
+	for(uint32_t k = 0; k < 4; k++) {
+		face->u0 = fminf(face->u0,quad[k].pos[ua]); face->u1 = fmaxf(face->u1,quad[k].pos[ua]);
+		face->v0 = fminf(face->v0,quad[k].pos[va]); face->v1 = fmaxf(face->v1,quad[k].pos[va]);
+	}
+	memcpy(face->norm, quad[0].norm, sizeof(face->norm));
+	memcpy(face->color, quad[0].color, sizeof(face->color));
+	face->layer = quad[0].layer;
+
+	// solve the affine map from (u,v) to texture coordinates using vertices 0, 1 and 2
+	float du1 = quad[1].pos[ua]-quad[0].pos[ua], dv1 = quad[1].pos[va]-quad[0].pos[va];
+	float du2 = quad[2].pos[ua]-quad[0].pos[ua], dv2 = quad[2].pos[va]-quad[0].pos[va];
+	float det = du1*dv2 - dv1*du2;
+	for(uint32_t i = 0; i < 2; i++) {
+		float dt1 = quad[1].tex[i]-quad[0].tex[i], dt2 = quad[2].tex[i]-quad[0].tex[i];
+		float a = (dt1*dv2 - dt2*dv1) / det;
+		float b = (du1*dt2 - du2*dt1) / det;
+		face->tex_map[i][0] = a;
+		face->tex_map[i][1] = b;
+		face->tex_map[i][2] = quad[0].tex[i] - a*quad[0].pos[ua] - b*quad[0].pos[va];
+		if(face->layer) {
+			float c = face->tex_map[i][2];
+			face->tex_phase[i] = (uint32_t)roundf((c - floorf(c))*1024) % 1024;
+		}
+	}
+}
+
+// is some opaque axis-aligned brick (of the n_ids in query_ids) overlapping a box?
+uint8_t __ao_occupied(uint32_t n_ids, const float* min, const float* max) {
+	for(uint32_t i = 0; i < n_ids; i++) {
+		brick_t* other = &render_world->bricks[query_ids[i]];
+		if(!brick_is_occluder(other)) continue;
+		float* omin = &other->bake_min.x;
+		float* omax = &other->bake_max.x;
+		uint8_t overlaps = 1;
+		for(uint32_t a = 0; a < 3 && overlaps; a++)
+			overlaps = omin[a] < max[a] && omax[a] > min[a];
+		if(overlaps) return 1;
+	}
+	return 0;
+}
+
+// set the ambient occlusion of a face's corners. each corner looks at three boxes AO_REACH deep
+// in front of the face: past each of its two edges, and past the corner itself. both edges blocked
+// is fully occluded, as in voxel AO, since the corner box can't be seen past them anyway.
+void bake_face_ao(bake_face_t* face) {
+	uint32_t axis = face->axis, ua = (axis+1)%3, va = (axis+2)%3;
+	float front0 = face->side ? face->plane + FACE_EPS : face->plane - AO_REACH;
+	float front1 = face->side ? face->plane + AO_REACH : face->plane - FACE_EPS;
+	vec3 qmin, qmax;
+	(&qmin.x)[axis] = front0, (&qmax.x)[axis] = front1;
+	(&qmin.x)[ua] = face->u0 - AO_REACH, (&qmax.x)[ua] = face->u1 + AO_REACH;
+	(&qmin.x)[va] = face->v0 - AO_REACH, (&qmax.x)[va] = face->v1 + AO_REACH;
+	uint32_t n_ids = query_static_bricks(qmin, qmax);
+	memset(face->ao, 0, sizeof(face->ao));
+	if(!n_ids) return;
+
+	for(uint32_t k = 0; k < 4; k++) {
+		int32_t su = k & 1 ? 1 : -1, sv = k & 2 ? 1 : -1;		// outward from the corner
+		float uc = su > 0 ? face->u1 : face->u0, vc = sv > 0 ? face->v1 : face->v0;
+		// the ranges past the corner's edges, and next to them inside the face
+		float u_out[2] = { su > 0 ? uc : uc - AO_REACH, su > 0 ? uc + AO_REACH : uc };
+		float v_out[2] = { sv > 0 ? vc : vc - AO_REACH, sv > 0 ? vc + AO_REACH : vc };
+		float u_in[2] = { su > 0 ? uc - AO_REACH : uc, su > 0 ? uc : uc + AO_REACH };
+		float v_in[2] = { sv > 0 ? vc - AO_REACH : vc, sv > 0 ? vc : vc + AO_REACH };
+		float* boxes[3][2] = { { u_out,v_in }, { u_in,v_out }, { u_out,v_out } };
+		uint8_t blocked[3];
+		for(uint32_t b = 0; b < 3; b++) {
+			float min[3], max[3];
+			min[axis] = front0, max[axis] = front1;
+			min[ua] = boxes[b][0][0], max[ua] = boxes[b][0][1];
+			min[va] = boxes[b][1][0], max[va] = boxes[b][1][1];
+			blocked[b] = __ao_occupied(n_ids, min, max);
+		}
+		face->ao[k] = blocked[0] && blocked[1] ? 3 : blocked[0] + blocked[1] + blocked[2];
+	}
+}
+
+float* ao_splits;		// split positions along u, then along v; reused between faces
+uint32_t max_ao_splits;
+
+// sort split positions and drop those within FACE_EPS of the previous one; returns how many are left
+uint32_t __unique_splits(float* splits, uint32_t n) {
+	qsort(splits, n, sizeof(float), __compare_floats);
+	uint32_t n_kept = 1;
+	for(uint32_t i = 1; i < n; i++)
+		if(splits[i] - splits[n_kept-1] > FACE_EPS) splits[n_kept++] = splits[i];
+	return n_kept;
+}
+
+// replace the last collected face with pieces, split at the edges of the opaque bricks in front of it
+// and AO_REACH past them, then set the occlusion of each piece. corner samples alone would leave a
+// large face (a baseplate) unshaded around the bricks resting on it. pieces under a brick touching
+// the face are left out; merge_bake_faces joins the rest back wherever their occlusion matches.
+void split_bake_face_ao() {
+	bake_face_t face = bake_faces[n_bake_faces-1];
+	uint32_t axis = face.axis, ua = (axis+1)%3, va = (axis+2)%3;
+	vec3 qmin, qmax;
+	(&qmin.x)[axis] = face.side ? face.plane + FACE_EPS : face.plane - AO_REACH;
+	(&qmax.x)[axis] = face.side ? face.plane + AO_REACH : face.plane - FACE_EPS;
+	(&qmin.x)[ua] = face.u0 - AO_REACH, (&qmax.x)[ua] = face.u1 + AO_REACH;
+	(&qmin.x)[va] = face.v0 - AO_REACH, (&qmax.x)[va] = face.v1 + AO_REACH;
+	uint32_t n_ids = query_static_bricks(qmin, qmax);
+
+	uint32_t max_splits = n_ids*4+2;		// per direction
+	if(max_ao_splits < max_splits*2) {
+		max_ao_splits = max_splits*2;
+		ao_splits = realloc(ao_splits, sizeof(float)*max_ao_splits);
+	}
+	float* us = ao_splits, *vs = ao_splits + max_splits;
+	uint32_t n_us = 0, n_vs = 0;
+	us[n_us++] = face.u0, us[n_us++] = face.u1;
+	vs[n_vs++] = face.v0, vs[n_vs++] = face.v1;
+	for(uint32_t i = 0; i < n_ids; i++) {
+		brick_t* other = &render_world->bricks[query_ids[i]];
+		if(!brick_is_occluder(other)) continue;
+		float* omin = &other->bake_min.x;
+		float* omax = &other->bake_max.x;
+		float u_edges[4] = { omin[ua] - AO_REACH, omin[ua], omax[ua], omax[ua] + AO_REACH };
+		float v_edges[4] = { omin[va] - AO_REACH, omin[va], omax[va], omax[va] + AO_REACH };
+		for(uint32_t e = 0; e < 4; e++) {
+			if(u_edges[e] > face.u0 + FACE_EPS && u_edges[e] < face.u1 - FACE_EPS) us[n_us++] = u_edges[e];
+			if(v_edges[e] > face.v0 + FACE_EPS && v_edges[e] < face.v1 - FACE_EPS) vs[n_vs++] = v_edges[e];
+		}
+	}
+	if(n_us == 2 && n_vs == 2) {
+		bake_face_ao(&bake_faces[n_bake_faces-1]);
+		return;
+	}
+	n_us = __unique_splits(us, n_us);
+	n_vs = __unique_splits(vs, n_vs);
+
+	// collect the visible pieces first; bake_face_ao replaces query_ids
+	uint32_t first = --n_bake_faces;
+	for(uint32_t i = 0; i+1 < n_us; i++)
+		for(uint32_t j = 0; j+1 < n_vs; j++) {
+			uint8_t hidden = 0;
+			for(uint32_t k = 0; k < n_ids && !hidden; k++) {
+				brick_t* other = &render_world->bricks[query_ids[k]];
+				if(!brick_is_occluder(other)) continue;
+				float* omin = &other->bake_min.x;
+				float* omax = &other->bake_max.x;
+				hidden = (face.side ? omin[axis] <= face.plane + FACE_EPS : omax[axis] >= face.plane - FACE_EPS)
+					&& omin[ua] <= us[i] + FACE_EPS && omax[ua] >= us[i+1] - FACE_EPS
+					&& omin[va] <= vs[j] + FACE_EPS && omax[va] >= vs[j+1] - FACE_EPS;
+			}
+			if(hidden) continue;
+			bake_face_t* piece = __new_bake_face();
+			*piece = face;
+			piece->u0 = us[i], piece->u1 = us[i+1];
+			piece->v0 = vs[j], piece->v1 = vs[j+1];
+		}
+	for(uint32_t i = first; i < n_bake_faces; i++)
+		bake_face_ao(&bake_faces[i]);
+}
+
+// faces can be merged if they lie on the same plane, look the same, and their texture
+// coordinates differ only by whole repeats (textures wrap, so the merged face tiles identically)
+uint8_t __same_face_group(bake_face_t* a, bake_face_t* b) {
+	if(a->axis != b->axis || a->side != b->side || fabsf(a->plane-b->plane) > FACE_EPS) return 0;
+	if(memcmp(a->color,b->color,4) || a->layer != b->layer) return 0;
+	if(!a->layer) return 1;
+	for(uint32_t i = 0; i < 2; i++)
+		if(fabsf(a->tex_map[i][0]-b->tex_map[i][0]) > FACE_EPS || fabsf(a->tex_map[i][1]-b->tex_map[i][1]) > FACE_EPS
+		|| a->tex_phase[i] != b->tex_phase[i]) return 0;
+	return 1;
+}
+
+int __compare_face_groups(const bake_face_t* a, const bake_face_t* b) {
+	if(a->axis != b->axis) return a->axis - b->axis;
+	if(a->side != b->side) return a->side - b->side;
+	if(a->plane != b->plane) return a->plane < b->plane ? -1 : 1;
+	int32_t c = memcmp(a->color,b->color,4);
+	if(c) return c;
+	if(a->layer != b->layer) return a->layer - b->layer;
+	if(!a->layer) return 0;
+	for(uint32_t i = 0; i < 2; i++) {
+		if(a->tex_phase[i] != b->tex_phase[i]) return a->tex_phase[i] - b->tex_phase[i];
+		for(uint32_t j = 0; j < 2; j++)
+			if(a->tex_map[i][j] != b->tex_map[i][j]) return a->tex_map[i][j] < b->tex_map[i][j] ? -1 : 1;
+	}
+	return 0;
+}
+
+// order by group, then into rows along u (same v0, v1; increasing u0)
+int __compare_faces_u(const void* pa, const void* pb) {
+	const bake_face_t* a = pa, *b = pb;
+	int32_t c = __compare_face_groups(a,b);
+	if(c) return c;
+	if(a->v0 != b->v0) return a->v0 < b->v0 ? -1 : 1;
+	if(a->v1 != b->v1) return a->v1 < b->v1 ? -1 : 1;
+	return (a->u0 > b->u0) - (a->u0 < b->u0);
+}
+
+// order by group, then into columns along v (same u0, u1; increasing v0)
+int __compare_faces_v(const void* pa, const void* pb) {
+	const bake_face_t* a = pa, *b = pb;
+	int32_t c = __compare_face_groups(a,b);
+	if(c) return c;
+	if(a->u0 != b->u0) return a->u0 < b->u0 ? -1 : 1;
+	if(a->u1 != b->u1) return a->u1 < b->u1 ? -1 : 1;
+	return (a->v0 > b->v0) - (a->v0 < b->v0);
+}
+
+// merge neighboring faces in one direction; returns the number of merges
+uint32_t __merge_faces(uint8_t along_v) {
+	qsort(bake_faces, n_bake_faces, sizeof(bake_face_t), along_v ? __compare_faces_v : __compare_faces_u);
+	uint32_t n_merged = 0, last = 0;
+	for(uint32_t i = 1; i < n_bake_faces; i++) {
+		bake_face_t* a = &bake_faces[last];
+		bake_face_t* b = &bake_faces[i];
+		uint8_t mergeable = __same_face_group(a,b) && (along_v
+			? fabsf(a->u0-b->u0) <= FACE_EPS && fabsf(a->u1-b->u1) <= FACE_EPS && fabsf(a->v1-b->v0) <= FACE_EPS
+			: fabsf(a->v0-b->v0) <= FACE_EPS && fabsf(a->v1-b->v1) <= FACE_EPS && fabsf(a->u1-b->u0) <= FACE_EPS);
+		// occlusion is interpolated across the merged quad, so it must be constant along the merge
+		const uint32_t ends[2][4] = { { 0,1,2,3 }, { 0,2,1,3 } };	// pairs of corners along u, along v
+		const uint32_t* e = ends[along_v];
+		mergeable = mergeable && a->ao[e[0]] == a->ao[e[1]] && b->ao[e[0]] == a->ao[e[0]] && b->ao[e[1]] == a->ao[e[0]]
+			&& a->ao[e[2]] == a->ao[e[3]] && b->ao[e[2]] == a->ao[e[2]] && b->ao[e[3]] == a->ao[e[2]];
+		if(mergeable) {
+			if(along_v) a->v1 = b->v1;
+			else a->u1 = b->u1;
+			b->merged = 1;
+			n_merged++;
+		} else last = i;
+	}
+	// compact away the absorbed faces
+	uint32_t n_kept = 0;
+	for(uint32_t i = 0; i < n_bake_faces; i++)
+		if(!bake_faces[i].merged) bake_faces[n_kept++] = bake_faces[i];
+	n_bake_faces = n_kept;
+	return n_merged;
+}
+
+// greedily merge the collected faces into larger rectangles and append them to a chunk mesh
+void merge_bake_faces(chunk_mesh_t* mesh) {
+	while(__merge_faces(0) + __merge_faces(1));
+
+	for(uint32_t i = 0; i < n_bake_faces; i++) {
+		bake_face_t* face = &bake_faces[i];
+		uint32_t axis = face->axis, ua = (axis+1)%3, va = (axis+2)%3;
+		// corners in cube face order; swapped on -axis faces to keep the winding facing outward
+		float corners[4][2] = { { face->u0,face->v0 }, { face->u1,face->v0 }, { face->u0,face->v1 }, { face->u1,face->v1 } };
+		uint8_t ao[4] = { face->ao[0], face->ao[1], face->ao[2], face->ao[3] };
+		if(!face->side) {
+			corners[1][0] = face->u0, corners[1][1] = face->v1;
+			corners[2][0] = face->u1, corners[2][1] = face->v0;
+			ao[1] = face->ao[2], ao[2] = face->ao[1];
+		}
+		chunk_vertex_t quad[4];
+		memset(quad,0,sizeof(quad));
+		for(uint32_t k = 0; k < 4; k++) {
+			float u = corners[k][0], v = corners[k][1];
+			quad[k].pos[axis] = face->plane;
+			quad[k].pos[ua] = u;
+			quad[k].pos[va] = v;
+			memcpy(quad[k].norm, face->norm, sizeof(face->norm));
+			for(uint32_t t = 0; t < 2; t++)
+				quad[k].tex[t] = face->tex_map[t][0]*u + face->tex_map[t][1]*v + face->tex_map[t][2];
+			memcpy(quad[k].color, face->color, 4);
+			quad[k].layer = face->layer;
+			quad[k].ao = ao[k];
+		}
+		push_chunk_quad(mesh, quad);
+	}
+}
+
+packed_chunk_vertex_t* packed_chunk_vtx;		// reused between uploads
+uint16_t* packed_chunk_idx;
+uint32_t max_packed_chunk_vtx, max_packed_chunk_idx;
+
+vec3 __chunk_origin(chunk_t* chunk) {
+	return (vec3){ (chunk->cx+.5f)*CHUNK_SIZE, (chunk->cy+.5f)*CHUNK_SIZE, (chunk->cz+.5f)*CHUNK_SIZE };
+}
+
+// choose the steps of a chunk's packed vertices: the finest powers of two, from CHUNK_POS_STEP and
+// CHUNK_TEX_STEP up, at which its bounds and the texture repeats of its quads fit in 16 bits.
+// (the same position step gives the same grid in every chunk, so there are no cracks between neighbors)
+void __chunk_steps(chunk_t* chunk, chunk_mesh_t* mesh) {
+	chunk->pos_step = CHUNK_POS_STEP;
+	chunk->tex_step = CHUNK_TEX_STEP;
+	if(!chunk->n_brick_ids) return;
+	vec3 origin = __chunk_origin(chunk);
+	vec3 lo = __sub_vec3(chunk->min, origin), hi = __sub_vec3(chunk->max, origin);
+	float extent = fmaxf(fmaxf(fmaxf(fabsf(lo.x),fabsf(lo.y)),fabsf(lo.z)), fmaxf(fmaxf(fabsf(hi.x),fabsf(hi.y)),fabsf(hi.z)));
+	while(extent/chunk->pos_step > 32767) chunk->pos_step *= 2;
+	float span = 0;
+	for(uint32_t q = 0; q < mesh->n_vtx; q += 4)
+		for(uint32_t t = 0; t < 2; t++) {
+			float t0 = FLT_MAX, t1 = -FLT_MAX;
+			for(uint32_t k = q; k < q+4; k++)
+				t0 = fminf(t0, mesh->vtx[k].tex[t]), t1 = fmaxf(t1, mesh->vtx[k].tex[t]);
+			span = fmaxf(span, t1 - floorf(t0));
+		}
+	while(span/chunk->tex_step > 65535) chunk->tex_step *= 2;
+}
+
+// octahedral encoding of a unit normal into two signed normalized bytes
+void __pack_oct_normal(const float* n, int8_t* out) {
+	float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	float x = n[0]/l1, y = n[1]/l1;
+	if(n[2] < 0) {
+		float fx = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+		float fy = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+		x = fx, y = fy;
+	}
+	out[0] = roundf(x*127), out[1] = roundf(y*127);
+}
+
+mesh_pool_t chunk_pool;		// every chunk's geometry and proxy, as packed_chunk_vertex_t
+
+void init_chunk_pool() {
+	init_mesh_pool(&chunk_pool, sizeof(packed_chunk_vertex_t));
+	uint32_t stride = sizeof(packed_chunk_vertex_t);
+	glVertexAttribPointer(0,3,GL_SHORT,GL_FALSE,stride,(void*)offsetof(packed_chunk_vertex_t,pos));
+	glVertexAttribPointer(1,2,GL_BYTE,GL_TRUE,stride,(void*)offsetof(packed_chunk_vertex_t,norm));
+	glVertexAttribPointer(2,2,GL_UNSIGNED_SHORT,GL_FALSE,stride,(void*)offsetof(packed_chunk_vertex_t,tex));
+	glVertexAttribPointer(3,3,GL_UNSIGNED_BYTE,GL_TRUE,stride,(void*)offsetof(packed_chunk_vertex_t,color));
+	glVertexAttribPointer(4,1,GL_UNSIGNED_BYTE,GL_FALSE,stride,(void*)offsetof(packed_chunk_vertex_t,layer));
+	for(uint32_t i = 0; i < 5; i++)
+		glEnableVertexAttribArray(i);
+}
+
+// pack a baked mesh and move it into chunk_pool, replacing the range's previous contents
+void upload_chunk_mesh(chunk_t* chunk, chunk_mesh_t* mesh, pool_range_t* range) {
+	if(!chunk_pool.vao_id) init_chunk_pool();
+	if(mesh->n_vtx > max_packed_chunk_vtx) {
+		max_packed_chunk_vtx = mesh->n_vtx;
+		packed_chunk_vtx = realloc(packed_chunk_vtx, sizeof(packed_chunk_vertex_t)*max_packed_chunk_vtx);
+	}
+	vec3 origin = __chunk_origin(chunk);
+	for(uint32_t q = 0; q < mesh->n_vtx; q += 4) {		// quads
+		float shift[2];
+		for(uint32_t t = 0; t < 2; t++)
+			shift[t] = floorf(fminf(fminf(mesh->vtx[q].tex[t],mesh->vtx[q+1].tex[t]), fminf(mesh->vtx[q+2].tex[t],mesh->vtx[q+3].tex[t])));
+		for(uint32_t i = q; i < q+4; i++) {
+			chunk_vertex_t* v = &mesh->vtx[i];
+			packed_chunk_vertex_t* out = &packed_chunk_vtx[i];
+			for(uint32_t a = 0; a < 3; a++)
+				out->pos[a] = roundf((v->pos[a] - (&origin.x)[a]) / chunk->pos_step);
+			__pack_oct_normal(v->norm, out->norm);
+			for(uint32_t t = 0; t < 2; t++)
+				out->tex[t] = roundf((v->tex[t] - shift[t]) / chunk->tex_step);
+			memcpy(out->color, v->color, 3);
+			out->layer = v->layer | v->ao << 6;
+		}
+	}
+	pool_remove_mesh(&chunk_pool, range);
+	if(mesh->n_vtx > 65536) {
+		*range = pool_add_mesh(&chunk_pool, packed_chunk_vtx, mesh->n_vtx, mesh->idx, mesh->n_idx, GL_UNSIGNED_INT);
+		return;
+	}
+	if(mesh->n_idx > max_packed_chunk_idx) {
+		max_packed_chunk_idx = mesh->n_idx;
+		packed_chunk_idx = realloc(packed_chunk_idx, sizeof(uint16_t)*max_packed_chunk_idx);
+	}
+	for(uint32_t i = 0; i < mesh->n_idx; i++)
+		packed_chunk_idx[i] = mesh->idx[i];
+	*range = pool_add_mesh(&chunk_pool, packed_chunk_vtx, mesh->n_vtx, packed_chunk_idx, mesh->n_idx, GL_UNSIGNED_SHORT);
+}
+
+GLint chunk_origin_loc, chunk_steps_loc;		// u_chunk_origin and u_chunk_steps of program 3
+
+// set how to unpack a chunk's vertices, before drawing it with program 3
+void bind_chunk_packing(chunk_t* chunk) {
+	vec3 origin = __chunk_origin(chunk);
+	glUniform3f(chunk_origin_loc, origin.x, origin.y, origin.z);
+	glUniform2f(chunk_steps_loc, chunk->pos_step, chunk->tex_step);
+}
+
+// a cell of a chunk's proxy: the bounds of the brick volume inside it, and its volume-weighted color
+typedef struct proxy_cell_t {
+	vec3 min, max;
+	vec4 color;
+	float volume;
+} proxy_cell_t;
+
+proxy_cell_t proxy_cells[PROXY_CELLS*PROXY_CELLS*PROXY_CELLS];
+
+// whether the face of proxy cell c on side (1 = +axis, -1 = -axis) is covered by its neighbor in the grid
+uint8_t __proxy_face_hidden(uint32_t cx, uint32_t cy, uint32_t cz, uint32_t axis, int32_t side) {
+	int32_t n[3] = { cx, cy, cz };
+	n[axis] += side;
+	if(n[axis] < 0 || n[axis] >= PROXY_CELLS) return 0;
+	proxy_cell_t* a = &proxy_cells[(cz*PROXY_CELLS + cy)*PROXY_CELLS + cx];
+	proxy_cell_t* b = &proxy_cells[(n[2]*PROXY_CELLS + n[1])*PROXY_CELLS + n[0]];
+	if(b->volume <= 0 || a->color.w < 1 || b->color.w < 1) return 0;
+	float* amin = &a->min.x, *amax = &a->max.x, *bmin = &b->min.x, *bmax = &b->max.x;
+	if(fabsf(side > 0 ? bmin[axis]-amax[axis] : amin[axis]-bmax[axis]) > FACE_EPS) return 0;
+	for(uint32_t i = 1; i < 3; i++) {
+		uint32_t t = (axis+i)%3;
+		if(bmin[t] > amin[t]+FACE_EPS || bmax[t] < amax[t]-FACE_EPS) return 0;
+	}
+	return 1;
+}
+
+// bake a chunk's far-field proxy: its bricks are reduced to one box per PROXY_CELLS^3 cell of its
+// bounds (tight around the brick volume in the cell, colored by the volume-weighted average), and
+// the box faces that are not covered by a neighbor box are merged like any other baked faces.
+// the proxy is untextured. expects chunk->min and chunk->max to be up to date.
+void bake_chunk_proxy(chunk_t* chunk) {
+	chunk_mesh_t* mesh = &bake_mesh;
+	mesh->n_vtx = mesh->n_idx = 0;
+	n_bake_faces = 0;
+	memset(proxy_cells,0,sizeof(proxy_cells));
+	for(uint32_t i = 0; i < PROXY_CELLS*PROXY_CELLS*PROXY_CELLS; i++) {
+		proxy_cells[i].min = (vec3){ FLT_MAX,FLT_MAX,FLT_MAX };
+		proxy_cells[i].max = (vec3){ -FLT_MAX,-FLT_MAX,-FLT_MAX };
+	}
+	vec3 cell_size = __scale_vec3(__sub_vec3(chunk->max, chunk->min), 1.0f/PROXY_CELLS);
+	float* cmin = &chunk->min.x, *csize = &cell_size.x;
+
+	for(uint32_t i = 0; i < chunk->n_brick_ids; i++) {
+		brick_t* brick = &render_world->bricks[chunk->brick_ids[i]];
+		vec3 bmin, bmax;
+		brick_aabb(brick, &bmin, &bmax);
+		int32_t lo[3], hi[3];
+		for(uint32_t a = 0; a < 3; a++) {
+			lo[a] = floorf(((&bmin.x)[a] - cmin[a]) / csize[a]);
+			hi[a] = floorf(((&bmax.x)[a] - cmin[a]) / csize[a]);
+			lo[a] = lo[a] < 0 ? 0 : lo[a] >= PROXY_CELLS ? PROXY_CELLS-1 : lo[a];
+			hi[a] = hi[a] < 0 ? 0 : hi[a] >= PROXY_CELLS ? PROXY_CELLS-1 : hi[a];
+		}
+		for(int32_t z = lo[2]; z <= hi[2]; z++)
+		for(int32_t y = lo[1]; y <= hi[1]; y++)
+		for(int32_t x = lo[0]; x <= hi[0]; x++) {
+			int32_t c[3] = { x,y,z };
+			float clip_min[3], clip_max[3], volume = 1;
+			for(uint32_t a = 0; a < 3; a++) {
+				clip_min[a] = fmaxf((&bmin.x)[a], cmin[a] + c[a]*csize[a]);
+				clip_max[a] = fminf((&bmax.x)[a], cmin[a] + (c[a]+1)*csize[a]);
+				volume *= clip_max[a] - clip_min[a];
+			}
+			if(volume <= 0) continue;
+			proxy_cell_t* cell = &proxy_cells[(z*PROXY_CELLS + y)*PROXY_CELLS + x];
+			float* pmin = &cell->min.x, *pmax = &cell->max.x;
+			for(uint32_t a = 0; a < 3; a++) {
+				pmin[a] = fminf(pmin[a], clip_min[a]);
+				pmax[a] = fmaxf(pmax[a], clip_max[a]);
+			}
+			cell->color.x += brick->color.x*volume, cell->color.y += brick->color.y*volume;
+			cell->color.z += brick->color.z*volume, cell->color.w += brick->color.w*volume;
+			cell->volume += volume;
+		}
+	}
+
+	for(uint32_t i = 0; i < PROXY_CELLS*PROXY_CELLS*PROXY_CELLS; i++) {
+		proxy_cell_t* cell = &proxy_cells[i];
+		if(cell->volume <= 0) continue;
+		cell->color.x /= cell->volume, cell->color.y /= cell->volume;
+		cell->color.z /= cell->volume, cell->color.w /= cell->volume;
+	}
+	for(uint32_t z = 0; z < PROXY_CELLS; z++)
+	for(uint32_t y = 0; y < PROXY_CELLS; y++)
+	for(uint32_t x = 0; x < PROXY_CELLS; x++) {
+		proxy_cell_t* cell = &proxy_cells[(z*PROXY_CELLS + y)*PROXY_CELLS + x];
+		if(cell->volume <= 0) continue;
+		vec3 dim = __sub_vec3(cell->max, cell->min);
+		float* color = &cell->color.x;
+		for(uint32_t f = 0; f < 6; f++) {
+			const float* n = &cube_vbo_data[f*32+3];
+			uint32_t axis = n[0] ? 0 : n[1] ? 1 : 2;
+			int32_t side = n[axis] > 0 ? 1 : -1;
+			if(__proxy_face_hidden(x,y,z,axis,side)) continue;
+			chunk_vertex_t quad[4];
+			memset(quad,0,sizeof(quad));
+			for(uint32_t k = 0; k < 4; k++) {
+				const float* v = &cube_vbo_data[(f*4+k)*8];
+				quad[k].pos[0] = cell->min.x + v[0]*dim.x;
+				quad[k].pos[1] = cell->min.y + v[1]*dim.y;
+				quad[k].pos[2] = cell->min.z + v[2]*dim.z;
+				memcpy(quad[k].norm, n, sizeof(float)*3);
+				for(uint32_t c = 0; c < 4; c++)
+					quad[k].color[c] = roundf(fminf(fmaxf(color[c],0),1)*255);
+			}
+			add_bake_face(quad, axis, side);
+		}
+	}
+	merge_bake_faces(mesh);
+	upload_chunk_mesh(chunk, mesh, &chunk->proxy);
+}
+
+// rebake a chunk's geometry and upload it
+void bake_chunk(uint32_t chunk_id) {
+	chunk_t* chunk = &render_world->chunks[chunk_id];
+	chunk_mesh_t* mesh = &bake_mesh;
+	mesh->n_vtx = mesh->n_idx = 0;
+	n_bake_faces = 0;
+	vec3 cmin = { FLT_MAX,FLT_MAX,FLT_MAX }, cmax = { -FLT_MAX,-FLT_MAX,-FLT_MAX };
+
+	for(uint32_t i = 0; i < chunk->n_brick_ids; i++) {
+		uint32_t brick_id = chunk->brick_ids[i];
+		brick_t* brick = &render_world->bricks[brick_id];
+		mat4 model = brick_model_matrix(brick);
+		mat4 rot = quat_to_mat4(brick->quat);
+		uint8_t aligned = brick_is_axis_aligned(brick);		// only faces of axis-aligned bricks are merged
+		uint8_t cull_faces = aligned && brick_is_occluder(brick);	// transparent bricks keep every face
+		for(uint32_t f = 0; f < 6; f++) {
+			chunk_vertex_t quad[4];
+			bake_brick_face(brick, &model, &rot, f, quad);
+			if(!aligned) {
+				push_chunk_quad(mesh, quad);
+				continue;
+			}
+			const float* n = &cube_vbo_data[f*32+3];
+			vec4 n4 = { n[0], n[1], n[2], 0 };
+			n4 = mat4_vec4(rot, n4);
+			uint32_t axis = fabsf(n4.x) > .5f ? 0 : fabsf(n4.y) > .5f ? 1 : 2;
+			int32_t side = (&n4.x)[axis] > 0 ? 1 : -1;
+			if(cull_faces && face_hidden(brick_id, axis, side)) continue;
+			add_bake_face(quad, axis, side);
+			split_bake_face_ao();
+		}
+		vec3 bmin, bmax;
+		brick_aabb(brick, &bmin, &bmax);
+		cmin.x = fminf(cmin.x,bmin.x); cmin.y = fminf(cmin.y,bmin.y); cmin.z = fminf(cmin.z,bmin.z);
+		cmax.x = fmaxf(cmax.x,bmax.x); cmax.y = fmaxf(cmax.y,bmax.y); cmax.z = fmaxf(cmax.z,bmax.z);
+	}
+	merge_bake_faces(mesh);
+	chunk->min = cmin;
+	chunk->max = cmax;
+	__chunk_steps(chunk, mesh);
+
+	upload_chunk_mesh(chunk, mesh, &chunk->geometry);
+	chunk->dirty = 0;
+	chunk->impostor_valid = 0;
+	if(chunk->n_brick_ids) bake_chunk_proxy(chunk);
+	else pool_remove_mesh(&chunk_pool, &chunk->proxy);
+}
+
+// rebake dirty chunks, up to CHUNK_REBUILDS_PER_FRAME of them
+void update_chunks() {
+	uint32_t n_rebuilt = 0;
+	for(uint32_t i = 0; i < render_world->n_chunks && n_rebuilt < CHUNK_REBUILDS_PER_FRAME; i++)
+		if(render_world->chunks[i].dirty) {
+			bake_chunk(i);
+			n_rebuilt++;
+		}
+}
+
+
+/*==================================================*/
+/*				VERTEX PULLING						*/
+/*==================================================*/
+// an alternative to chunk baking (brick_render_mode = BRICK_RENDER_PULL): every default-mesh
+// brick is one 32 byte record in a buffer texture, and program 4 builds cube corners, normals
+// and texture coordinates from gl_VertexID, fetching the brick record by instance. all such
+// bricks draw in one glDrawArraysInstanced call with no vertex buffers bound. records are only
+// re-uploaded for bricks marked through pull_mark_dirty (every edit goes through refile_brick),
+// plus bricks that move on their own (gravity or translate_brick), which are repacked every frame.
+// records of bricks not drawn this way have texture_set PULL_SKIP, so they can be culled on the GPU.
+
+#define MAX_TEXTURE_SETS 256
+#define PULL_SKIP 0xFFFF		// texture_set of a record that is not drawn
+
+typedef struct brick_record_t {
+	float pos[3];
+	uint32_t color;				// RGBA8
+	int16_t quat[4];			// snorm16
+	uint16_t scale[3];			// half floats
+	uint16_t texture_set;		// index into texture_sets
+} brick_record_t;
+
+// the per-face texture array layers (+1, 0 = untextured) and repeat flags of a brick,
+// shared by every brick textured the same way
+typedef struct texture_set_t {
+	uint8_t layers[6];
+	uint8_t repeat_mask;
+} texture_set_t;
+
+texture_set_t texture_sets[MAX_TEXTURE_SETS];
+uint32_t n_texture_sets;
+
+brick_record_t* pull_records;	// CPU copy of the record buffer, indexed by brick ID
+uint8_t* pull_flags;			// per brick; 1 if it is drawn through the pulling path
+uint32_t pull_capacity;			// bricks the record buffer has room for
+uint32_t* pull_dirty_ids;		// bricks whose records must be repacked and uploaded
+uint32_t n_pull_dirty_ids, max_pull_dirty_ids;
+uint8_t* pull_dirty;			// per brick; 1 if already in pull_dirty_ids
+uint32_t n_pull_dirty;
+GLuint pull_record_buffer, pull_record_tex;
+GLuint pull_index_buffer, pull_index_tex;
+GLuint pull_vao;				// empty; everything is fetched in the vertex shader
+uint32_t* pull_visible;			// IDs of the bricks drawn this frame
+uint32_t max_pull_visible;
+uint32_t* pull_moving_ids;		// bricks that move on their own, repacked every frame
+uint32_t n_pull_moving_ids, max_pull_moving_ids;
+uint8_t* pull_moving;			// per brick (pull_capacity); 1 if in pull_moving_ids
+
+// return the texture set of a brick, or -1 if there is no room or a texture has no array layer
+int32_t get_texture_set(brick_t* brick) {
+	texture_set_t set;
+	memset(&set,0,sizeof(texture_set_t));
+	for(uint32_t f = 0; f < 6; f++) {
+		if(!brick->texture_ids[f]) continue;
+		set.layers[f] = texture_layer(brick->texture_ids[f]);
+		if(!set.layers[f]) return -1;
+		if(brick->repeat_textures[f]) set.repeat_mask |= 1 << f;
+	}
+	for(uint32_t i = 0; i < n_texture_sets; i++)
+		if(!memcmp(&texture_sets[i],&set,sizeof(texture_set_t))) return i;
+	if(n_texture_sets == MAX_TEXTURE_SETS) return -1;
+	texture_sets[n_texture_sets] = set;
+	return n_texture_sets++;
+}
+
+void pull_mark_dirty(uint32_t brick_id) {
+	if(n_pull_dirty <= brick_id) {
+		uint32_t n = render_world->n_bricks > brick_id ? render_world->n_bricks : brick_id+1;
+		pull_dirty = realloc(pull_dirty, n);
+		memset(pull_dirty+n_pull_dirty, 0, n-n_pull_dirty);
+		n_pull_dirty = n;
+	}
+	if(pull_dirty[brick_id]) return;
+	pull_dirty[brick_id] = 1;
+	if(n_pull_dirty_ids == max_pull_dirty_ids) {
+		max_pull_dirty_ids = max_pull_dirty_ids ? max_pull_dirty_ids*2 : 256;
+		pull_dirty_ids = realloc(pull_dirty_ids, sizeof(uint32_t)*max_pull_dirty_ids);
+	}
+	pull_dirty_ids[n_pull_dirty_ids++] = brick_id;
+}
+
+// pack a brick's record, and set whether it can be drawn through the pulling path
+void __pack_pull_record(uint32_t brick_id) {
+	brick_t* brick = &render_world->bricks[brick_id];
+	brick_record_t* record = &pull_records[brick_id];
+	if((brick->is_dynamic || brick->has_gravity) && !brick->deleted && !pull_moving[brick_id]) {
+		if(n_pull_moving_ids == max_pull_moving_ids) {
+			max_pull_moving_ids = max_pull_moving_ids ? max_pull_moving_ids*2 : 256;
+			pull_moving_ids = realloc(pull_moving_ids, sizeof(uint32_t)*max_pull_moving_ids);
+		}
+		pull_moving_ids[n_pull_moving_ids++] = brick_id;
+		pull_moving[brick_id] = 1;
+	}
+	int32_t set = brick->deleted || brick->mesh_id || brick->color.w < 1 ? -1 : get_texture_set(brick);
+	pull_flags[brick_id] = set != -1;
+	brick_list_set(&unpulled_bricks, brick_id, !brick->deleted && set == -1);
+	if(set == -1) {
+		record->texture_set = PULL_SKIP;
+		return;
+	}
+	record->pos[0] = brick->pos.x, record->pos[1] = brick->pos.y, record->pos[2] = brick->pos.z;
+	record->color = pack_color(brick->color);
+	float* q = &brick->quat.x;
+	for(uint32_t i = 0; i < 4; i++)
+		record->quat[i] = roundf(fminf(fmaxf(q[i],-1),1)*32767);
+	record->scale[0] = float_to_half(brick->scale.x);
+	record->scale[1] = float_to_half(brick->scale.y);
+	record->scale[2] = float_to_half(brick->scale.z);
+	record->texture_set = set;
+}
+
+int __compare_ids(const void* a, const void* b) {
+	uint32_t ia = *(const uint32_t*)a, ib = *(const uint32_t*)b;
+	return (ia > ib) - (ia < ib);
+}
+
+// repack dirty and moving bricks, and upload their records in contiguous runs
+void update_pull_records() {
+	if(!pull_vao) {
+		glGenVertexArrays(1,&pull_vao);
+		GLuint buffers[2];
+		glGenBuffers(2,buffers);
+		pull_record_buffer = buffers[0];
+		pull_index_buffer = buffers[1];
+		glGenTextures(1,&pull_record_tex);
+		glGenTextures(1,&pull_index_tex);
+	}
+	for(uint32_t i = 0; i < n_pull_moving_ids;) {		// drop bricks that stopped moving or were deleted
+		brick_t* brick = &render_world->bricks[pull_moving_ids[i]];
+		if((brick->is_dynamic || brick->has_gravity) && !brick->deleted) {
+			pull_mark_dirty(pull_moving_ids[i++]);
+			continue;
+		}
+		pull_moving[pull_moving_ids[i]] = 0;
+		pull_moving_ids[i] = pull_moving_ids[--n_pull_moving_ids];
+	}
+
+	if(render_world->n_bricks > pull_capacity) {		// grow, then upload everything
+		pull_capacity = render_world->n_bricks*2 > 1024 ? render_world->n_bricks*2 : 1024;
+		pull_records = realloc(pull_records, sizeof(brick_record_t)*pull_capacity);
+		pull_flags = realloc(pull_flags, pull_capacity);
+		memset(pull_flags, 0, pull_capacity);
+		pull_moving = realloc(pull_moving, pull_capacity);
+		memset(pull_moving, 0, pull_capacity);
+		n_pull_moving_ids = 0;
+		for(uint32_t i = 0; i < render_world->n_bricks; i++)
+			__pack_pull_record(i);
+		glBindBuffer(GL_TEXTURE_BUFFER, pull_record_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(brick_record_t)*pull_capacity, 0, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(brick_record_t)*render_world->n_bricks, pull_records);
+		glBindTexture(GL_TEXTURE_BUFFER, pull_record_tex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, pull_record_buffer);
+		for(uint32_t i = 0; i < n_pull_dirty_ids; i++)
+			pull_dirty[pull_dirty_ids[i]] = 0;
+		n_pull_dirty_ids = 0;
+		return;
+	}
+
+	qsort(pull_dirty_ids, n_pull_dirty_ids, sizeof(uint32_t), __compare_ids);
+	glBindBuffer(GL_TEXTURE_BUFFER, pull_record_buffer);
+	for(uint32_t i = 0; i < n_pull_dirty_ids;) {
+		uint32_t first = pull_dirty_ids[i], n = 0;
+		while(i < n_pull_dirty_ids && pull_dirty_ids[i] == first+n) {
+			pull_dirty[pull_dirty_ids[i]] = 0;
+			__pack_pull_record(pull_dirty_ids[i]);
+			i++, n++;
+		}
+		glBufferSubData(GL_TEXTURE_BUFFER, sizeof(brick_record_t)*first, sizeof(brick_record_t)*n, &pull_records[first]);
+	}
+	n_pull_dirty_ids = 0;
+}
+
+
+/*==================================================*/
+/*				GPU CULLING							*/
+/*==================================================*/
+// where compute shaders are supported (GL 4.3), pulled bricks are culled on the GPU instead of
+// listed on the CPU: cull_pulled_bricks runs one invocation per brick record (records are already
+// on the GPU, and only re-uploaded on edits), tests the brick's box against the view frustum and the
+// depth pyramid of the previous frame, and appends survivors to the visible list read by program 4,
+// counting them into the instance count of an indirect draw. the CPU work of the pulled path then
+// doesn't grow with the number of bricks. the pyramid is a R32F texture whose every texel holds the
+// farthest depth of the texels below it; a box is hidden if its nearest depth, projected with the
+// previous frame's matrices, is behind the farthest depth of the (at most 2x2) texels covering it at
+// the level matching its size. boxes that were partly off screen or behind the camera in that frame
+// are kept. without compute shaders, render_pulled_bricks lists bricks on the CPU as before.
+
+#define CULL_GROUP_SIZE 64			// local size of the culling shader
+#define HIZ_GROUP_SIZE 8			// local size (both axes) of the pyramid shader
+
+PFNGLDISPATCHCOMPUTEPROC dispatch_compute;		// 0 if GPU culling is unsupported
+PFNGLMEMORYBARRIERPROC memory_barrier;
+PFNGLBINDIMAGETEXTUREPROC bind_image_texture;
+PFNGLDRAWARRAYSINDIRECTPROC draw_arrays_indirect;
+GLuint cull_program, hiz_program;
+GLuint cull_command_buffer;			// DrawArraysIndirectCommand of the pulled bricks
+uint32_t cull_capacity;				// bricks pull_index_buffer has room for
+GLuint hiz_depth_tex;				// copy of the depth buffer
+GLuint hiz_tex;						// the pyramid; level 0 is the size of the depth buffer
+GLint hiz_width, hiz_height;		// allocated size of both textures
+GLint hiz_size[2];					// size of the depth buffer the pyramid was built from
+uint32_t hiz_levels;				// levels built
+mat4 hiz_view_proj;					// the matrices the pyramid's frame was rendered with
+uint8_t hiz_valid;					// 1 if the pyramid was built last frame
+
+const char* cull_shader_src =
+	"#version 430										\n"
+	"layout(local_size_x = %d) in;						\n"
+	"layout(std430, binding = 0) writeonly buffer visible_list { uint visible[]; };\n"
+	"layout(std430, binding = 1) buffer draw_command { uint count, instance_count, first, base_instance; };\n"
+	"uniform usamplerBuffer u_records;					\n"	// as program 4
+	"uniform sampler2D u_hiz;							\n"
+	"uniform uint u_n_bricks;							\n"
+	"uniform mat4 u_view_proj;							\n"
+	"uniform mat4 u_hiz_view_proj;						\n"
+	"uniform ivec3 u_hiz_size;							\n"	// size of level 0, levels; 0 levels to skip the test
+	"float snorm16(uint v) { return max(float(int(v << 16) >> 16) / 32767.0, -1.0); }\n"
+	"float half_to_float(uint h) {						\n"
+	"	uint e = (h >> 10) & 31u, m = h & 1023u;		\n"
+	"	float v = e == 0u ? float(m) * exp2(-24.0) : float(m | 1024u) * exp2(float(e) - 25.0);\n"
+	"	return (h & 0x8000u) != 0u ? -v : v;			\n"
+	"}													\n"
+	"bool occluded(vec3 corners[8]) {					\n"
+	"	vec3 lo = vec3(1e30), hi = vec3(-1e30);			\n"
+	"	for(int i = 0; i < 8; i++) {					\n"
+	"		vec4 p = u_hiz_view_proj * vec4(corners[i],1.0);\n"
+	"		if(p.w <= 0.0) return false;				\n"
+	"		lo = min(lo, p.xyz / p.w), hi = max(hi, p.xyz / p.w);\n"
+	"	}												\n"
+	"	if(any(lessThan(lo, vec3(-1.0))) || any(greaterThan(hi.xy, vec2(1.0)))) return false;\n"
+	"	vec2 size = vec2(u_hiz_size.xy);				\n"
+	"	vec2 p0 = (lo.xy*.5+.5) * size, p1 = (hi.xy*.5+.5) * size;\n"
+	"	float extent = max(p1.x - p0.x, p1.y - p0.y);	\n"
+	"	int level = min(int(ceil(log2(max(extent, 1.0)))), u_hiz_size.z-1);\n"
+	"	ivec2 last = max(u_hiz_size.xy >> level, 1) - 1;\n"	// the last row and column also cover odd leftovers
+	"	ivec2 t0 = min(ivec2(p0) >> level, last), t1 = min(ivec2(p1) >> level, last);\n"
+	"	float depth = 0.0;								\n"
+	"	for(int y = t0.y; y <= t1.y; y++)				\n"
+	"		for(int x = t0.x; x <= t1.x; x++)			\n"
+	"			depth = max(depth, texelFetch(u_hiz, ivec2(x,y), level).r);\n"
+	"	return lo.z*.5+.5 > depth;						\n"
+	"}													\n"
+	"void main() {										\n"
+	"	uint brick = gl_GlobalInvocationID.x;			\n"
+	"	if(brick >= u_n_bricks) return;					\n"
+	"	uvec4 r0 = texelFetch(u_records, int(brick)*2);	\n"
+	"	uvec4 r1 = texelFetch(u_records, int(brick)*2+1);\n"
+	"	if((r1.w >> 16) == %du) return;					\n"	// PULL_SKIP
+	"	vec3 pos = uintBitsToFloat(r0.xyz);				\n"
+	"	vec4 q = vec4(snorm16(r1.x & 0xFFFFu), snorm16(r1.x >> 16), snorm16(r1.y & 0xFFFFu), snorm16(r1.y >> 16));\n"
+	"	vec3 s = vec3(half_to_float(r1.z & 0xFFFFu), half_to_float(r1.z >> 16), half_to_float(r1.w & 0xFFFFu));\n"
+	"	mat3 rot = mat3(								\n"
+	"		1.0-2.0*(q.y*q.y+q.z*q.z), 2.0*(q.x*q.y+q.z*q.w), 2.0*(q.x*q.z-q.y*q.w),\n"
+	"		2.0*(q.x*q.y-q.z*q.w), 1.0-2.0*(q.x*q.x+q.z*q.z), 2.0*(q.y*q.z+q.x*q.w),\n"
+	"		2.0*(q.x*q.z+q.y*q.w), 2.0*(q.y*q.z-q.x*q.w), 1.0-2.0*(q.x*q.x+q.y*q.y));\n"
+	"	vec3 corners[8];								\n"
+	"	uint outside = 63u;								\n"	// clip planes every corner is outside of
+	"	for(int i = 0; i < 8; i++) {					\n"
+	"		corners[i] = rot * (vec3(i & 1, (i >> 1) & 1, i >> 2) * s) + pos;\n"
+	"		vec4 p = u_view_proj * vec4(corners[i],1.0);\n"
+	"		outside &= uint(p.x < -p.w) | uint(p.x > p.w) << 1 | uint(p.y < -p.w) << 2 |\n"
+	"			uint(p.y > p.w) << 3 | uint(p.z < -p.w) << 4 | uint(p.z > p.w) << 5;\n"
+	"	}												\n"
+	"	if(outside != 0u) return;						\n"
+	"	if(u_hiz_size.z > 0 && occluded(corners)) return;\n"
+	"	visible[atomicAdd(instance_count, 1u)] = brick;	\n"
+	"}													";
+
+// builds one level of the pyramid from the depth copy (u_step 1) or from the level above (u_step 2)
+const char* hiz_shader_src =
+	"#version 430										\n"
+	"layout(local_size_x = %d, local_size_y = %d) in;	\n"
+	"layout(r32f) writeonly uniform image2D u_dst;		\n"
+	"uniform sampler2D u_src;							\n"
+	"uniform int u_src_level;							\n"
+	"uniform ivec2 u_src_size;							\n"
+	"uniform ivec2 u_dst_size;							\n"
+	"uniform int u_step;								\n"
+	"void main() {										\n"
+	"	ivec2 dst = ivec2(gl_GlobalInvocationID.xy);	\n"
+	"	if(any(greaterThanEqual(dst, u_dst_size))) return;\n"
+	"	ivec2 t0 = dst * u_step, t1 = t0 + u_step-1;	\n"
+	"	if(dst.x == u_dst_size.x-1) t1.x = u_src_size.x-1;\n"	// odd leftovers go to the last row and column
+	"	if(dst.y == u_dst_size.y-1) t1.y = u_src_size.y-1;\n"
+	"	float depth = 0.0;								\n"
+	"	for(int y = t0.y; y <= t1.y; y++)				\n"
+	"		for(int x = t0.x; x <= t1.x; x++)			\n"
+	"			depth = max(depth, texelFetch(u_src, ivec2(x,y), u_src_level).r);\n"
+	"	imageStore(u_dst, dst, vec4(depth));			\n"
+	"}													";
+
+GLuint __compile_compute(const char* src) {
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader,1,&src,0);
+	glCompileShader(shader);
+	GLint success = 0;
+	glGetShaderiv(shader,GL_COMPILE_STATUS,&success);
+	if(!success) {
+		printf("failed to compile compute shader.\n");
+		GLint max_length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &max_length);
+		char* info_log = calloc(1,max_length);
+		glGetShaderInfoLog(shader, max_length, &max_length, &info_log[0]);
+		printf("%s\n", info_log);
+		exit(1);
+	}
+	GLuint program = glCreateProgram();
+	glAttachShader(program,shader);
+	glLinkProgram(program);
+	glGetProgramiv(program,GL_LINK_STATUS,&success);
+	if(!success) {
+		printf("failed to link compute shader.\n");
+		exit(1);
+	}
+	glDetachShader(program, shader);
+	glDeleteShader(shader);
+	return program;
+}
+
+void init_gpu_culling() {
+	if(!glfwExtensionSupported("GL_ARB_compute_shader") || !glfwExtensionSupported("GL_ARB_shader_storage_buffer_object")
+	|| !glfwExtensionSupported("GL_ARB_shader_image_load_store") || !glfwExtensionSupported("GL_ARB_draw_indirect"))
+		return;
+	dispatch_compute = (PFNGLDISPATCHCOMPUTEPROC)glfwGetProcAddress("glDispatchCompute");
+	memory_barrier = (PFNGLMEMORYBARRIERPROC)glfwGetProcAddress("glMemoryBarrier");
+	bind_image_texture = (PFNGLBINDIMAGETEXTUREPROC)glfwGetProcAddress("glBindImageTexture");
+	draw_arrays_indirect = (PFNGLDRAWARRAYSINDIRECTPROC)glfwGetProcAddress("glDrawArraysIndirect");
+	if(!memory_barrier || !bind_image_texture || !draw_arrays_indirect) dispatch_compute = 0;
+	if(!dispatch_compute) return;
+
+	char src[4096];
+	sprintf(src, cull_shader_src, CULL_GROUP_SIZE, PULL_SKIP);
+	cull_program = __compile_compute(src);
+	glUseProgram(cull_program);
+	glUniform1i(glGetUniformLocation(cull_program,"u_records"), 0);
+	glUniform1i(glGetUniformLocation(cull_program,"u_hiz"), 1);
+	sprintf(src, hiz_shader_src, HIZ_GROUP_SIZE, HIZ_GROUP_SIZE);
+	hiz_program = __compile_compute(src);
+	glUseProgram(hiz_program);
+	glUniform1i(glGetUniformLocation(hiz_program,"u_dst"), 0);
+	glUniform1i(glGetUniformLocation(hiz_program,"u_src"), 0);
+
+	glGenBuffers(1,&cull_command_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*4, 0, GL_DYNAMIC_DRAW);
+	GLuint textures[2];
+	glGenTextures(2,textures);
+	hiz_depth_tex = textures[0], hiz_tex = textures[1];
+}
+
+// 1 if the pulled bricks' visibility is decided by cull_pulled_bricks rather than occlusion_cull
+uint8_t gpu_culls_pulled_bricks() {
+	return dispatch_compute && brick_render_mode == BRICK_RENDER_PULL;
+}
+
+uint8_t gpu_culls_brick(uint32_t brick_id) {
+	return gpu_culls_pulled_bricks() && brick_id < pull_capacity && pull_flags[brick_id];
+}
+
+// list the pulled bricks visible with view_proj into pull_index_buffer, and their count into
+// cull_command_buffer; call after update_pull_records
+void cull_pulled_bricks(mat4 view_proj) {
+	if(cull_capacity < pull_capacity) {
+		cull_capacity = pull_capacity;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, pull_index_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t)*cull_capacity, 0, GL_DYNAMIC_DRAW);
+	}
+	const GLuint command[4] = { 36, 0, 0, 0 };		// vertices, instances, first vertex, base instance
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_command_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), command);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pull_index_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cull_command_buffer);
+
+	glUseProgram(cull_program);
+	uint8_t occlusion = enable_occlusion_culling && hiz_valid;
+	glUniform1ui(glGetUniformLocation(cull_program,"u_n_bricks"), render_world->n_bricks);
+	glUniformMatrix4fv(glGetUniformLocation(cull_program,"u_view_proj"), 1, GL_FALSE, &view_proj.m00);
+	glUniformMatrix4fv(glGetUniformLocation(cull_program,"u_hiz_view_proj"), 1, GL_FALSE, &hiz_view_proj.m00);
+	glUniform3i(glGetUniformLocation(cull_program,"u_hiz_size"), hiz_size[0], hiz_size[1], occlusion ? hiz_levels : 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, pull_record_tex);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, hiz_tex);
+	glActiveTexture(GL_TEXTURE0);
+	dispatch_compute((render_world->n_bricks + CULL_GROUP_SIZE-1) / CULL_GROUP_SIZE, 1, 1);
+	memory_barrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// (re)allocate the depth copy and the pyramid to hold a depth buffer of width x height
+void __size_hiz(GLint width, GLint height) {
+	if(width <= hiz_width && height <= hiz_height) return;
+	hiz_width = width > hiz_width ? width : hiz_width;
+	hiz_height = height > hiz_height ? height : hiz_height;
+	glBindTexture(GL_TEXTURE_2D, hiz_depth_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, hiz_width, hiz_height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, hiz_tex);
+	uint32_t level = 0;
+	for(GLint w = hiz_width, h = hiz_height;; w = w > 1 ? w/2 : 1, h = h > 1 ? h/2 : 1) {
+		glTexImage2D(GL_TEXTURE_2D, level++, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, 0);
+		if(w == 1 && h == 1) break;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level-1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// build the depth pyramid from the current viewport of the bound framebuffer, drawn with view_proj,
+// for the next frame's cull_pulled_bricks
+void build_depth_pyramid(mat4 view_proj) {
+	GLint viewport[4], framebuffer, samples = 0;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &samples);
+	hiz_valid = 0;
+	if(samples) return;			// can't be copied into a texture
+	__size_hiz(viewport[2], viewport[3]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, hiz_depth_tex);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	glUseProgram(hiz_program);
+	GLint src_size[2] = { viewport[2], viewport[3] };
+	for(hiz_levels = 0;; hiz_levels++) {
+		GLint dst_size[2] = { viewport[2] >> hiz_levels, viewport[3] >> hiz_levels };
+		dst_size[0] = dst_size[0] ? dst_size[0] : 1, dst_size[1] = dst_size[1] ? dst_size[1] : 1;
+		glBindTexture(GL_TEXTURE_2D, hiz_levels ? hiz_tex : hiz_depth_tex);
+		glUniform1i(glGetUniformLocation(hiz_program,"u_src_level"), hiz_levels ? hiz_levels-1 : 0);
+		glUniform2iv(glGetUniformLocation(hiz_program,"u_src_size"), 1, src_size);
+		glUniform2iv(glGetUniformLocation(hiz_program,"u_dst_size"), 1, dst_size);
+		glUniform1i(glGetUniformLocation(hiz_program,"u_step"), hiz_levels ? 2 : 1);
+		bind_image_texture(0, hiz_tex, hiz_levels, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		dispatch_compute((dst_size[0] + HIZ_GROUP_SIZE-1) / HIZ_GROUP_SIZE, (dst_size[1] + HIZ_GROUP_SIZE-1) / HIZ_GROUP_SIZE, 1);
+		memory_barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		src_size[0] = dst_size[0], src_size[1] = dst_size[1];
+		if(dst_size[0] == 1 && dst_size[1] == 1) break;
+	}
+	hiz_levels++;
+	hiz_size[0] = viewport[2], hiz_size[1] = viewport[3];
+	hiz_view_proj = view_proj;
+	hiz_valid = 1;
+}
+
+
+/*==================================================*/
+/*				PROFILER							*/
+/*==================================================*/
+// each render pass is wrapped in profile_begin/profile_end, which time it on the CPU and with a
+// GL_TIME_ELAPSED query. queries are reused round robin and read PROFILE_LATENCY frames later, only
+// if their result is already available, so reading them never stalls. draw calls and primitives
+// are counted with profile_count from the draw sites. averages over the last PROFILE_WINDOW frames
+// are printed every PROFILE_REPORT_INTERVAL frames while enable_profiler is set (F3).
+// passes can't nest: GL allows one GL_TIME_ELAPSED query at a time.
+
+#define PASS_ENTITIES 0
+#define PASS_STATIC_BRICKS 1	// baked chunks (with impostors) or pulled bricks
+#define PASS_LOOSE_BRICKS 2		// everything render_loose_bricks draws
+#define PASS_OVERLAY 3			// render_overlay
+#define PASS_MINIMAP 4			// render_minimap
+#define N_PASSES 5
+#define PROFILE_LATENCY 4		// frames before a query is read back
+#define PROFILE_WINDOW 60		// frames averaged
+#define PROFILE_REPORT_INTERVAL 120
+
+typedef struct profile_pass_t {
+	const char* name;
+	GLuint queries[PROFILE_LATENCY];
+	uint8_t pending[PROFILE_LATENCY];
+	float cpu_ms[PROFILE_WINDOW], gpu_ms[PROFILE_WINDOW];
+	uint32_t n_cpu, n_gpu;			// samples taken (ring positions)
+	uint32_t draws[PROFILE_WINDOW], primitives[PROFILE_WINDOW];
+	double cpu_start;
+} profile_pass_t;
+
+profile_pass_t profile_passes[N_PASSES] = {
+	{ "entities" }, { "static bricks" }, { "loose bricks" }, { "overlay" }, { "minimap" } };
+int32_t profile_current = -1;		// pass being recorded
+uint32_t profile_frame;
+
+// start timing a pass
+void profile_begin(uint32_t pass_id) {
+	if(!enable_profiler) return;
+	profile_pass_t* pass = &profile_passes[pass_id];
+	if(!pass->queries[0]) glGenQueries(PROFILE_LATENCY, pass->queries);
+	uint32_t slot = profile_frame % PROFILE_LATENCY;
+	if(pass->pending[slot]) {		// the query PROFILE_LATENCY frames ago
+		GLuint available = 0;
+		glGetQueryObjectuiv(pass->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available) {
+			GLuint64 ns;
+			glGetQueryObjectui64v(pass->queries[slot], GL_QUERY_RESULT, &ns);
+			pass->gpu_ms[pass->n_gpu++ % PROFILE_WINDOW] = ns / 1e6;
+		}
+		pass->pending[slot] = 0;
+	}
+	uint32_t i = pass->n_cpu % PROFILE_WINDOW;
+	pass->draws[i] = pass->primitives[i] = 0;
+	pass->cpu_start = glfwGetTime();
+	glBeginQuery(GL_TIME_ELAPSED, pass->queries[slot]);
+	pass->pending[slot] = 1;
+	profile_current = pass_id;
+}
+
+void profile_end() {
+	if(profile_current == -1) return;
+	profile_pass_t* pass = &profile_passes[profile_current];
+	glEndQuery(GL_TIME_ELAPSED);
+	pass->cpu_ms[pass->n_cpu++ % PROFILE_WINDOW] = (glfwGetTime() - pass->cpu_start) * 1000;
+	profile_current = -1;
+}
+
+// count draw calls and primitives toward the current pass
+void profile_count(uint32_t draws, uint32_t primitives) {
+	if(profile_current == -1) return;
+	profile_pass_t* pass = &profile_passes[profile_current];
+	uint32_t i = pass->n_cpu % PROFILE_WINDOW;
+	pass->draws[i] += draws;
+	pass->primitives[i] += primitives;
+}
+
+// print each pass's averages
+void profile_report() {
+	printf("%-14s %9s %9s %7s %11s\n", "pass", "cpu ms", "gpu ms", "draws", "primitives");
+	for(uint32_t p = 0; p < N_PASSES; p++) {
+		profile_pass_t* pass = &profile_passes[p];
+		uint32_t n_cpu = pass->n_cpu < PROFILE_WINDOW ? pass->n_cpu : PROFILE_WINDOW;
+		uint32_t n_gpu = pass->n_gpu < PROFILE_WINDOW ? pass->n_gpu : PROFILE_WINDOW;
+		if(!n_cpu) continue;
+		double cpu = 0, gpu = 0, draws = 0, primitives = 0;
+		for(uint32_t i = 0; i < n_cpu; i++)
+			cpu += pass->cpu_ms[i], draws += pass->draws[i], primitives += pass->primitives[i];
+		for(uint32_t i = 0; i < n_gpu; i++)
+			gpu += pass->gpu_ms[i];
+		printf("%-14s %9.3f %9.3f %7.0f %11.0f\n", pass->name, cpu/n_cpu, n_gpu ? gpu/n_gpu : 0,
+			draws/n_cpu, primitives/n_cpu);
+	}
+}
+
+// call once per frame, after every pass
+void profile_end_frame() {
+	if(!enable_profiler) return;
+	if(++profile_frame % PROFILE_REPORT_INTERVAL == 0 && !headless_frames) profile_report();
+}
+
+/*==================================================*/
+/*				CLUSTERED LIGHTING					*/
+/*==================================================*/
+// point lights are binned each frame into a grid of clusters over the view frustum: CLUSTER_X by
+// CLUSTER_Y screen tiles, and CLUSTER_Z depth slices spaced exponentially from near to far. each
+// cluster lists the lights whose sphere may reach it (at most MAX_CLUSTER_LIGHTS), so the brick
+// shaders only loop over a few lights per pixel however many are in the scene. the grid, the light
+// index lists and the lights themselves are uploaded to buffer textures on units 6-8.
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define N_CLUSTERS (CLUSTER_X*CLUSTER_Y*CLUSTER_Z)
+#define MAX_CLUSTER_LIGHTS 128
+#define CLUSTER_UNIT 6			// texture units of the buffer textures
+#define LIGHT_INDEX_UNIT 7
+#define LIGHT_UNIT 8
+
+#define __STR(x) #x
+#define STR(x) __STR(x)
+
+// point_lights(world position, normal) sums the clustered point lights at a fragment
+#define CLUSTERED_LIGHTS_BLOCK \
+	"uniform usamplerBuffer u_clusters;					\n"	/* first light index, light count */ \
+	"uniform usamplerBuffer u_light_indices;			\n" \
+	"uniform samplerBuffer u_lights;					\n"	/* position & radius, color */ \
+	"vec3 point_lights(vec3 pos, vec3 norm) {			\n" \
+	"	if(u_cluster_params.z == 0.0) return vec3(0);	\n" \
+	"	vec4 view_pos = u_view * vec4(pos,1);			\n" \
+	"	vec4 clip = u_proj * view_pos;					\n" \
+	"	vec2 tile = floor((clip.xy / clip.w * .5 + .5) * vec2(" STR(CLUSTER_X) "," STR(CLUSTER_Y) "));\n" \
+	"	ivec2 xy = ivec2(clamp(tile, vec2(0), vec2(" STR(CLUSTER_X) "-1," STR(CLUSTER_Y) "-1)));\n" \
+	"	float slice = log(-view_pos.z / u_cluster_params.x) / log(u_cluster_params.y / u_cluster_params.x);\n" \
+	"	int z = clamp(int(slice * " STR(CLUSTER_Z) ".0), 0, " STR(CLUSTER_Z) "-1);\n" \
+	"	uvec2 cluster = texelFetch(u_clusters, (z*" STR(CLUSTER_Y) " + xy.y)*" STR(CLUSTER_X) " + xy.x).rg;\n" \
+	"	vec3 light = vec3(0);							\n" \
+	"	for(uint i = 0u; i < cluster.y; i++) {			\n" \
+	"		int l = int(texelFetch(u_light_indices, int(cluster.x + i)).r);\n" \
+	"		vec4 sphere = texelFetch(u_lights, l*2);	\n" \
+	"		vec3 d = sphere.xyz - pos;					\n" \
+	"		float dist = length(d);						\n" \
+	"		float falloff = clamp(1.0 - dist / sphere.w, 0.0, 1.0);\n" \
+	"		light += texelFetch(u_lights, l*2+1).rgb * max(dot(norm, d / max(dist, 1e-4)), 0.0) * falloff*falloff;\n" \
+	"	}												\n" \
+	"	return light;									\n" \
+	"}													\n"
+
+GLuint cluster_buffer, light_index_buffer, light_buffer;
+GLuint cluster_tex, light_index_tex, light_tex;
+uint32_t cluster_counts[N_CLUSTERS], cluster_data[N_CLUSTERS*2];
+uint32_t* light_indices;
+uint32_t max_light_indices;
+float* light_data;
+uint32_t max_light_data;
+uint32_t n_cluster_lights;		// lights binned this frame; the shaders skip point lights while 0
+
+typedef struct light_bounds_t {
+	uint16_t min[3], max[3];	// inclusive cluster ranges
+} light_bounds_t;
+
+light_bounds_t* light_bounds;
+uint32_t max_light_bounds;
+
+// point each program's light samplers at their units
+void set_light_samplers(GLuint program_id) {
+	glUseProgram(program_id);
+	glUniform1i(glGetUniformLocation(program_id,"u_clusters"), CLUSTER_UNIT);
+	glUniform1i(glGetUniformLocation(program_id,"u_light_indices"), LIGHT_INDEX_UNIT);
+	glUniform1i(glGetUniformLocation(program_id,"u_lights"), LIGHT_UNIT);
+}
+
+void init_lighting() {
+	GLuint buffers[3], textures[3];
+	glGenBuffers(3,buffers);
+	glGenTextures(3,textures);
+	cluster_buffer = buffers[0], light_index_buffer = buffers[1], light_buffer = buffers[2];
+	cluster_tex = textures[0], light_index_tex = textures[1], light_tex = textures[2];
+}
+
+// depth slice of a view-space distance in front of the camera
+uint32_t __cluster_slice(float depth) {
+	float slice = logf(depth / near) / logf(far / near) * CLUSTER_Z;
+	return slice < 0 ? 0 : slice >= CLUSTER_Z ? CLUSTER_Z-1 : slice;
+}
+
+// conservative cluster tile range of the view-space interval [lo,hi] on one axis, for depths
+// between near_depth and far_depth; scale is the projection's scale on that axis
+uint8_t __cluster_tiles(float lo, float hi, float near_depth, float far_depth, float scale, uint32_t n_tiles,
+	uint16_t* min, uint16_t* max) {
+	float ndc_lo = scale * lo / (lo < 0 ? near_depth : far_depth);
+	float ndc_hi = scale * hi / (hi > 0 ? near_depth : far_depth);
+	if(ndc_lo > 1 || ndc_hi < -1) return 0;
+	float t_lo = (fmaxf(ndc_lo,-1) * .5f + .5f) * n_tiles, t_hi = (fminf(ndc_hi,1) * .5f + .5f) * n_tiles;
+	*min = t_lo >= n_tiles ? n_tiles-1 : t_lo;
+	*max = t_hi >= n_tiles ? n_tiles-1 : t_hi;
+	return 1;
+}
+
+// bin the world's lights into clusters for this view and projection, and upload them
+void update_light_clusters(mat4 view, mat4 proj) {
+	if(max_light_bounds < render_world->n_lights) {
+		max_light_bounds = render_world->n_lights;
+		light_bounds = realloc(light_bounds, sizeof(light_bounds_t)*max_light_bounds);
+	}
+	if(max_light_data < render_world->n_lights) {
+		max_light_data = render_world->n_lights;
+		light_data = realloc(light_data, sizeof(float)*8*max_light_data);
+	}
+
+	// find the clusters each light's sphere overlaps
+	memset(cluster_counts, 0, sizeof(cluster_counts));
+	n_cluster_lights = 0;
+	for(uint32_t i = 0; i < render_world->n_lights; i++) {
+		point_light_t* light = &render_world->lights[i];
+		if(light->deleted) continue;
+		vec3 pos = light->pos;
+		if(light->brick_id != -1) {
+			brick_t* brick = &render_world->bricks[light->brick_id];
+			if(brick->deleted) continue;
+			vec3 min, max;
+			brick_aabb(brick, &min, &max);
+			pos = __scale_vec3(__add_vec3(min, max), .5f);
+		}
+		vec4 p4 = { pos.x, pos.y, pos.z, 1 };
+		vec4 c = mat4_vec4(view, p4);
+		float r = light->radius;
+		float near_depth = -c.z - r, far_depth = -c.z + r;
+		if(far_depth < near || near_depth > far) continue;
+		light_bounds_t bounds;
+		bounds.min[2] = __cluster_slice(fmaxf(near_depth, near));
+		bounds.max[2] = __cluster_slice(fminf(far_depth, far));
+		if(near_depth <= near) {		// sphere reaches the camera plane; may cover any tile
+			bounds.min[0] = bounds.min[1] = 0;
+			bounds.max[0] = CLUSTER_X-1, bounds.max[1] = CLUSTER_Y-1;
+		} else if(!__cluster_tiles(c.x-r, c.x+r, near_depth, far_depth, proj.m00, CLUSTER_X, &bounds.min[0], &bounds.max[0])
+			|| !__cluster_tiles(c.y-r, c.y+r, near_depth, far_depth, proj.m11, CLUSTER_Y, &bounds.min[1], &bounds.max[1]))
+			continue;
+		float* data = &light_data[n_cluster_lights*8];
+		data[0] = pos.x, data[1] = pos.y, data[2] = pos.z, data[3] = r;
+		data[4] = light->color.x, data[5] = light->color.y, data[6] = light->color.z, data[7] = 0;
+		light_bounds[n_cluster_lights++] = bounds;
+		for(uint32_t z = bounds.min[2]; z <= bounds.max[2]; z++)
+			for(uint32_t y = bounds.min[1]; y <= bounds.max[1]; y++)
+				for(uint32_t x = bounds.min[0]; x <= bounds.max[0]; x++) {
+					uint32_t* count = &cluster_counts[(z*CLUSTER_Y + y)*CLUSTER_X + x];
+					if(*count < MAX_CLUSTER_LIGHTS) (*count)++;
+				}
+	}
+
+	// lay out each cluster's list, then fill them in
+	uint32_t n_indices = 0;
+	for(uint32_t i = 0; i < N_CLUSTERS; i++) {
+		cluster_data[i*2] = n_indices;
+		cluster_data[i*2+1] = 0;
+		n_indices += cluster_counts[i];
+	}
+	if(max_light_indices < n_indices) {
+		max_light_indices = n_indices;
+		light_indices = realloc(light_indices, sizeof(uint32_t)*max_light_indices);
+	}
+	for(uint32_t i = 0; i < n_cluster_lights; i++) {
+		light_bounds_t bounds = light_bounds[i];
+		for(uint32_t z = bounds.min[2]; z <= bounds.max[2]; z++)
+			for(uint32_t y = bounds.min[1]; y <= bounds.max[1]; y++)
+				for(uint32_t x = bounds.min[0]; x <= bounds.max[0]; x++) {
+					uint32_t c = (z*CLUSTER_Y + y)*CLUSTER_X + x;
+					if(cluster_data[c*2+1] < cluster_counts[c])
+						light_indices[cluster_data[c*2] + cluster_data[c*2+1]++] = i;
+				}
+	}
+
+	// upload (orphaning last frame's data)
+	glBindBuffer(GL_TEXTURE_BUFFER, cluster_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(cluster_data), cluster_data, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, light_index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t)*(n_indices ? n_indices : 1), n_indices ? light_indices : 0, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(float)*8*(n_cluster_lights ? n_cluster_lights : 1), n_cluster_lights ? light_data : 0, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0+CLUSTER_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_tex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, cluster_buffer);
+	glActiveTexture(GL_TEXTURE0+LIGHT_INDEX_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, light_index_tex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, light_index_buffer);
+	glActiveTexture(GL_TEXTURE0+LIGHT_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, light_tex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_buffer);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/*==================================================*/
+/*				STREAMING							*/
+/*==================================================*/
+// per-draw and per-frame uniform data is written into a ring of buffer segments and bound with
+// glBindBufferRange. with GL_ARB_buffer_storage the ring is persistently mapped, so an upload is
+// a memcpy; each segment is fenced when it is left, and waited on before it is written again.
+// without it, data is staged in memory, sent with glBufferSubData before it is bound, and the
+// buffer is orphaned whenever a segment fills up (or the frame ends).
+
+#define STREAM_SEGMENTS 3				// triple buffered
+#define STREAM_SEGMENT_SIZE (1 << 20)	// bytes
+#define FRAME_DATA_BINDING 0
+#define DRAW_DATA_BINDING 1
+
+// std140 uniform blocks shared by the shader programs
+#define FRAME_DATA_BLOCK "layout(std140) uniform frame_data { mat4 u_view, u_proj; vec4 u_cluster_params; };\n"
+#define DRAW_DATA_BLOCK "layout(std140) uniform draw_data { mat4 u_model; vec4 u_color; vec4 u_textured_faces[2]; };\n"
+
+typedef struct draw_data_t {
+	float model[16];
+	float color[4];
+	float textured_faces[8];	// 6 used; vec4[2] in std140
+} draw_data_t;
+
+typedef struct stream_buffer_t {
+	GLuint buffer_id;
+	uint8_t* data;				// persistent mapping of every segment, or one segment of staging memory
+	uint8_t persistent;
+	uint32_t segment;			// segment being written
+	uint32_t offset;			// write offset within it
+	uint32_t flushed;			// staging bytes already sent to the buffer (fallback only)
+	GLsync fences[STREAM_SEGMENTS];
+	GLint alignment;			// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+} stream_buffer_t;
+
+stream_buffer_t stream;
+
+void init_stream() {
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &stream.alignment);
+	glGenBuffers(1, &stream.buffer_id);
+	glBindBuffer(GL_UNIFORM_BUFFER, stream.buffer_id);
+	PFNGLBUFFERSTORAGEPROC buffer_storage = 0;
+	if(glfwExtensionSupported("GL_ARB_buffer_storage"))
+		buffer_storage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+	if(buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		buffer_storage(GL_UNIFORM_BUFFER, STREAM_SEGMENT_SIZE*STREAM_SEGMENTS, 0, flags);
+		stream.data = glMapBufferRange(GL_UNIFORM_BUFFER, 0, STREAM_SEGMENT_SIZE*STREAM_SEGMENTS, flags);
+		stream.persistent = stream.data != 0;
+	}
+	if(!stream.persistent) {
+		glBufferData(GL_UNIFORM_BUFFER, STREAM_SEGMENT_SIZE, 0, GL_STREAM_DRAW);
+		stream.data = malloc(STREAM_SEGMENT_SIZE);
+	}
+}
+
+// leave the current segment and start writing the next one
+void __stream_advance() {
+	if(!stream.persistent) {
+		glBindBuffer(GL_UNIFORM_BUFFER, stream.buffer_id);
+		glBufferData(GL_UNIFORM_BUFFER, STREAM_SEGMENT_SIZE, 0, GL_STREAM_DRAW);	// orphan
+		stream.offset = stream.flushed = 0;
+		return;
+	}
+	stream.fences[stream.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream.segment = (stream.segment + 1) % STREAM_SEGMENTS;
+	stream.offset = 0;
+	GLsync fence = stream.fences[stream.segment];
+	if(!fence) return;
+	while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+	stream.fences[stream.segment] = 0;
+}
+
+// reserve size bytes for this frame; returns where to write them, and their buffer offset
+void* stream_alloc(uint32_t size, uint32_t* offset) {
+	if(size > STREAM_SEGMENT_SIZE) {
+		printf("internal error at stream_alloc: %u bytes exceeds the segment size.\n", size);
+		exit(1);
+	}
+	if(stream.offset + size > STREAM_SEGMENT_SIZE)
+		__stream_advance();
+	uint32_t base = stream.persistent ? stream.segment*STREAM_SEGMENT_SIZE : 0;
+	*offset = base + stream.offset;
+	void* ptr = stream.data + *offset;
+	stream.offset = (stream.offset + size + stream.alignment-1) / stream.alignment * stream.alignment;
+	if(stream.offset > STREAM_SEGMENT_SIZE) stream.offset = STREAM_SEGMENT_SIZE;
+	return ptr;
+}
+
+// send staged data to the buffer (fallback only); needed before drawing from it other than by stream_bind_range
+void stream_flush() {
+	if(stream.persistent || stream.flushed >= stream.offset) return;
+	glBindBuffer(GL_UNIFORM_BUFFER, stream.buffer_id);
+	glBufferSubData(GL_UNIFORM_BUFFER, stream.flushed, stream.offset-stream.flushed, stream.data+stream.flushed);
+	stream.flushed = stream.offset;
+}
+
+// bind written stream data to an indexed buffer target (sending any staged data first)
+void stream_bind_range(GLenum target, GLuint index, uint32_t offset, uint32_t size) {
+	stream_flush();
+	glBindBufferRange(target, index, stream.buffer_id, offset, size);
+}
+
+// call once the frame's draws are submitted
+void stream_end_frame() {
+	__stream_advance();
+}
+
+// bind the view and projection matrices for the following draws
+void bind_frame_data(float* view_data, float* proj_data) {
+	uint32_t offset;
+	float* data = stream_alloc(sizeof(float)*36, &offset);
+	memcpy(data, view_data, sizeof(float)*16);
+	memcpy(data+16, proj_data, sizeof(float)*16);
+	data[32] = near, data[33] = far;
+	data[34] = n_cluster_lights && proj_data[15] == 0;		// clusters are only built for the perspective camera
+	data[35] = 0;
+	stream_bind_range(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, offset, sizeof(float)*36);
+}
+
+// bind the model matrix, color and textured face flags (optional) for the next draw
+void bind_draw_data(mat4 model, vec4 color, float* textured_faces) {
+	uint32_t offset;
+	draw_data_t* data = stream_alloc(sizeof(draw_data_t), &offset);
+	float model_data[] = {
+		model.m00, model.m10, model.m20, model.m30,
+		model.m01, model.m11, model.m21, model.m31,
+		model.m02, model.m12, model.m22, model.m32,
+		model.m03, model.m13, model.m23, model.m33
+	};
+	memcpy(data->model, model_data, sizeof(model_data));
+	data->color[0] = color.x, data->color[1] = color.y, data->color[2] = color.z, data->color[3] = color.w;
+	for(uint32_t f = 0; f < 8; f++)
+		data->textured_faces[f] = textured_faces && f < 6 ? textured_faces[f] : 0;
+	stream_bind_range(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, offset, sizeof(draw_data_t));
+}
+
+
+/*==================================================*/
+/*				RENDERING							*/
+/*==================================================*/
+// render as the global 'player' variable
+// a lot of the work was done in init_gl
+// shader and program setting, and mesh generation (mesh 0 is our brick)
+
+// these are the main programs:
+// program_ids[0] - basic. reads only vec3 pos attribute; solid color (vtx_format >= 0).
+// program_ids[1] - reads vec3 pos and vec3 norm attributes (vtx_format >= 1).
+// program_ids[2] - reads vec3 pos, vec3 norm and vec2 tex attributes (vtx_format 2); per-face textures.
+// program_ids[3] - baked chunk geometry (packed_chunk_vertex_t); per-vertex color and texture array layer.
+// program_ids[4] - pulled bricks; no vertex attributes, reads brick records from a buffer texture.
+// program_ids[5] - mesh_pool geometry (vtx_format 3 layout); per-draw data from instance attributes 5-11.
+// program_ids[6] - wireframe boxes; unit cube edges, instanced by vec3 minimum, dimensions and color.
+// program_ids[7] - humanoids; default mesh, six instances (body parts) per humanoid_instance_t.
+// program_ids[8] - chunk impostor billboards; a triangle strip per instance, textured from the impostor atlas.
+// program_ids[9] - weighted transparency composite; one full-screen triangle.
+// program_ids[10] - minimap; one quad filling the viewport, textured from the minimap's tiles.
+
+GLuint* program_ids;
+uint32_t n_programs;
+
+// linked programs are cached in SHADER_CACHE_DIR as program binaries, named by a hash of their
+// sources and the driver's vendor, renderer and version strings. a missing file, or one the driver
+// rejects (e.g. after a driver update it did not change the version string for), is recompiled.
+
+#define SHADER_CACHE_DIR "shader_cache"
+
+PFNGLGETPROGRAMBINARYPROC get_program_binary;	// 0 if program binaries are unsupported
+PFNGLPROGRAMBINARYPROC program_binary;
+PFNGLPROGRAMPARAMETERIPROC program_parameteri;
+
+void init_program_cache() {
+	if(!glfwExtensionSupported("GL_ARB_get_program_binary")) return;
+	GLint n_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+	if(!n_formats) return;
+	get_program_binary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+	program_binary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+	program_parameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+	if(!program_binary || !program_parameteri) get_program_binary = 0;
+	mkdir(SHADER_CACHE_DIR, 0755);
+}
+
+// path of the cache file for a pair of shader sources on this driver (64-bit FNV-1a)
+void __program_cache_path(const char* vtx_shader_src, const char* pxl_shader_src, char* path) {
+	const char* parts[] = { vtx_shader_src, pxl_shader_src, (const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+	uint64_t hash = 14695981039346656037ull;
+	for(uint32_t i = 0; i < 5; i++) {
+		const char* c = parts[i] ? parts[i] : "";
+		do {
+			hash ^= (uint8_t)*c;
+			hash *= 1099511628211ull;
+		} while(*c++);
+	}
+	sprintf(path, "%s/%016llx.bin", SHADER_CACHE_DIR, (unsigned long long)hash);
+}
+
+// load a program from the cache; returns 0 if there is no usable binary
+GLuint __load_cached_program(const char* path) {
+	FILE* f = fopen(path,"rb");
+	if(!f) return 0;
+	fseek(f,0,SEEK_END);
+	long size = ftell(f) - sizeof(GLenum);
+	fseek(f,0,SEEK_SET);
+	GLenum format;
+	void* data = size > 0 ? malloc(size) : 0;
+	uint8_t ok = data && fread(&format,sizeof(GLenum),1,f) == 1 && fread(data,size,1,f) == 1;
+	fclose(f);
+	GLuint program = 0;
+	if(ok) {
+		program = glCreateProgram();
+		program_binary(program, format, data, size);
+		GLint success = 0;
+		glGetProgramiv(program,GL_LINK_STATUS,&success);
+		if(!success) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	free(data);
+	return program;
+}
+
+void __save_cached_program(GLuint program, const char* path) {
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if(!size) return;
+	void* data = malloc(size);
+	GLenum format;
+	get_program_binary(program, size, 0, &format, data);
+	FILE* f = fopen(path,"wb");
+	if(!f) {
+		printf("error in __save_cached_program: could not write %s.\n", path);
+		free(data);
+		return;
+	}
+	fwrite(&format,sizeof(GLenum),1,f);
+	fwrite(data,size,1,f);
+	fclose(f);
+	free(data);
+}
+
+// compile and link a GL program from source
+GLuint __compile_program(const char* vtx_shader_src, const char* pxl_shader_src) {
+	GLuint vtx_shader = glCreateShader(GL_VERTEX_SHADER);
+	GLuint pxl_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(vtx_shader,1,&vtx_shader_src,0);
+	glShaderSource(pxl_shader,1,&pxl_shader_src,0);
+	glCompileShader(vtx_shader);
+	GLint success = 0;
+	glGetShaderiv(vtx_shader,GL_COMPILE_STATUS,&success);
+	if(!success) {
+		printf("failed to compile vertex shader.\n");
+		GLint max_length = 0;
+		glGetShaderiv(vtx_shader, GL_INFO_LOG_LENGTH, &max_length);
+		char* info_log = calloc(1,max_length);
+		glGetShaderInfoLog(vtx_shader, max_length, &max_length, &info_log[0]);
+		printf("%s\n", info_log);
+		exit(1);
+	}
+	glCompileShader(pxl_shader);
+	glGetShaderiv(pxl_shader,GL_COMPILE_STATUS,&success);
+	if(!success) {
+		printf("failed to compile pixel shader.\n");
+		GLint max_length = 0;
+		glGetShaderiv(pxl_shader, GL_INFO_LOG_LENGTH, &max_length);
+		char* info_log = calloc(1,max_length);
+		glGetShaderInfoLog(pxl_shader, max_length, &max_length, &info_log[0]);
+		printf("%s\n", info_log);
+		exit(1);
+	}
+	GLuint program = glCreateProgram();
+	glAttachShader(program,vtx_shader);
+	glAttachShader(program,pxl_shader);
+	if(get_program_binary) program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	glGetProgramiv(program,GL_LINK_STATUS,&success);
+	if(!success) {
+		printf("failed to link shaders.\n");
+		exit(1);
+	}
+	glDetachShader(program, vtx_shader);
+	glDetachShader(program, pxl_shader);
+	glDeleteShader(vtx_shader);
+	glDeleteShader(pxl_shader);
+	return program;
+}
+
+// create a new GL program, from the program cache if possible
+GLuint create_program(const char* vtx_shader_src, const char* pxl_shader_src) {
+	char cache_path[64];
+	GLuint program = 0;
+	if(get_program_binary) {
+		__program_cache_path(vtx_shader_src, pxl_shader_src, cache_path);
+		program = __load_cached_program(cache_path);
+	}
+	if(!program) {
+		program = __compile_program(vtx_shader_src, pxl_shader_src);
+		if(get_program_binary) __save_cached_program(program, cache_path);
+	}
+	program_ids = realloc(program_ids, sizeof(GLuint)*(n_programs+1));
+	program_ids[n_programs] = program;
+
+	// point the shared uniform blocks at their stream bindings
+	GLuint block = glGetUniformBlockIndex(program_ids[n_programs], "frame_data");
+	if(block != GL_INVALID_INDEX) glUniformBlockBinding(program_ids[n_programs], block, FRAME_DATA_BINDING);
+	block = glGetUniformBlockIndex(program_ids[n_programs], "draw_data");
+	if(block != GL_INVALID_INDEX) glUniformBlockBinding(program_ids[n_programs], block, DRAW_DATA_BINDING);
+	return program_ids[n_programs++];
+}
+
+// submit bricks that are not baked or pulled through the shared mesh pool: one
+// glMultiDrawElementsIndirect call per batch, each command drawing one brick whose per-draw data
+// is an instance (selected by base instance). without GL 4.3 the same commands are drawn in a
+// CPU loop, pointing the instance attributes at each brick's data in turn.
+
+#define DRAW_BATCH 4096			// commands per indirect call; keeps a batch well inside a stream segment
+
+typedef struct draw_command_t {	// DrawElementsIndirectCommand
+	uint32_t count, instance_count, first_index, base_vertex, base_instance;
+} draw_command_t;
+
+typedef struct draw_instance_t {
+	float model[16];
+	float color[4];
+	float layers[6];			// per-face texture array layer +1, 0 = untextured
+	float base_vertex;			// to find the face of a vertex
+	float repeat_mask;
+} draw_instance_t;
+
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC multi_draw_elements_indirect;	// 0 if unsupported
+draw_command_t* draw_commands;
+draw_instance_t* draw_instances;
+uint32_t n_draws, max_draws;
+
+void init_brick_draws() {
+	if(glfwExtensionSupported("GL_ARB_multi_draw_indirect") && glfwExtensionSupported("GL_ARB_base_instance"))
+		multi_draw_elements_indirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+}
+
+// queue a brick for submit_brick_draws; returns 0 if it must be drawn individually instead
+uint8_t queue_brick_draw(brick_t* brick) {
+	draw_instance_t instance;
+	uint32_t repeat_mask = 0;
+	for(uint32_t f = 0; f < 6; f++) {
+		instance.layers[f] = brick->texture_ids[f] ? texture_layer(brick->texture_ids[f]) : 0;
+		if(brick->texture_ids[f] && !instance.layers[f]) return 0;		// not in the texture array
+		if(brick->repeat_textures[f]) repeat_mask |= 1 << f;
+	}
+	if(n_draws == max_draws) {
+		max_draws = max_draws ? max_draws*2 : 256;
+		draw_commands = realloc(draw_commands, sizeof(draw_command_t)*max_draws);
+		draw_instances = realloc(draw_instances, sizeof(draw_instance_t)*max_draws);
+	}
+	mesh_t* mesh = &meshes[brick->mesh_id];
+	mat4 model = brick_model_matrix(brick);
+	float model_data[] = {
+		model.m00, model.m10, model.m20, model.m30,
+		model.m01, model.m11, model.m21, model.m31,
+		model.m02, model.m12, model.m22, model.m32,
+		model.m03, model.m13, model.m23, model.m33
+	};
+	memcpy(instance.model, model_data, sizeof(model_data));
+	instance.color[0] = brick->color.x, instance.color[1] = brick->color.y;
+	instance.color[2] = brick->color.z, instance.color[3] = brick->color.w;
+	instance.base_vertex = mesh->range.base_vertex;
+	instance.repeat_mask = repeat_mask;
+	draw_instances[n_draws] = instance;
+	draw_command_t command = { mesh->range.n_indices, 1, mesh->range.first_slot, mesh->range.base_vertex, 0 };
+	draw_commands[n_draws++] = command;
+	return 1;
+}
+
+// draw and clear every queued brick
+void submit_brick_draws() {
+	if(!n_draws) return;
+	glUseProgram(program_ids[5]);
+	glUniform1i(glGetUniformLocation(program_ids[5],"u_textures"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+	glBindVertexArray(mesh_pool.vao_id);
+
+	for(uint32_t first = 0; first < n_draws; first += DRAW_BATCH) {
+		uint32_t n = n_draws-first < DRAW_BATCH ? n_draws-first : DRAW_BATCH;
+		uint32_t instance_offset, command_offset;
+		memcpy(stream_alloc(sizeof(draw_instance_t)*n, &instance_offset), &draw_instances[first], sizeof(draw_instance_t)*n);
+		draw_command_t* commands = stream_alloc(sizeof(draw_command_t)*n, &command_offset);
+		for(uint32_t i = 0; i < n; i++) {
+			draw_commands[first+i].base_instance = i;
+			commands[i] = draw_commands[first+i];
+		}
+		stream_flush();
+
+		// instance attributes 5-11: model matrix columns, color, layers, base vertex & repeat mask
+		glBindBuffer(GL_ARRAY_BUFFER, stream.buffer_id);
+		if(multi_draw_elements_indirect) {
+			for(uint32_t a = 0; a < 7; a++)
+				glVertexAttribPointer(5+a,4,GL_FLOAT,GL_FALSE,sizeof(draw_instance_t),(void*)(uintptr_t)(instance_offset + a*16));
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer_id);
+			multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(uintptr_t)command_offset, n, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			profile_count(1, 0);
+		} else for(uint32_t i = 0; i < n; i++) {
+			draw_command_t* command = &draw_commands[first+i];
+			uint32_t offset = instance_offset + i*sizeof(draw_instance_t);
+			for(uint32_t a = 0; a < 7; a++)
+				glVertexAttribPointer(5+a,4,GL_FLOAT,GL_FALSE,sizeof(draw_instance_t),(void*)(uintptr_t)(offset + a*16));
+			glDrawElementsBaseVertex(GL_TRIANGLES, command->count, GL_UNSIGNED_INT, (void*)(uintptr_t)(command->first_index*4), command->base_vertex);
+			profile_count(1, 0);
+		}
+		for(uint32_t i = 0; i < n; i++)
+			profile_count(0, draw_commands[first+i].count/3);
+	}
+	n_draws = 0;
+}
+
+// chunks far from the camera are drawn as their proxy mesh (see bake_chunk_proxy), and the farthest
+// as impostors: a capture of the chunk rendered into a tile of a shared atlas, drawn as a billboard
+// facing the direction it was captured from. captures are cached and only redone once the view
+// direction turns IMPOSTOR_ANGLE away (or the chunk is rebaked), a few per frame. each LOD
+// threshold must be passed by LOD_HYSTERESIS either way before a chunk switches, to avoid popping.
+
+#define CHUNK_LOD_FULL 0
+#define CHUNK_LOD_PROXY 1
+#define CHUNK_LOD_IMPOSTOR 2
+#define LOD_PROXY_DIST 150			// studs from the camera to the chunk's center
+#define LOD_IMPOSTOR_DIST 450
+#define LOD_HYSTERESIS 0.1f
+#define IMPOSTOR_ATLAS_SIZE 2048
+#define IMPOSTOR_TILE_SIZE 128
+#define IMPOSTOR_TILES_PER_ROW (IMPOSTOR_ATLAS_SIZE/IMPOSTOR_TILE_SIZE)
+#define IMPOSTOR_ANGLE 0.99f		// cosine; about 8 degrees
+#define IMPOSTOR_CAPTURES_PER_FRAME 4
+
+GLuint impostor_fbo, impostor_atlas_id, impostor_depth_id, impostor_vao;
+uint8_t impostor_tile_used[IMPOSTOR_TILES_PER_ROW*IMPOSTOR_TILES_PER_ROW];
+float* impostor_instances;		// center & radius, capture direction & tile, per billboard
+uint32_t n_impostor_instances, max_impostor_instances;
+
+void init_impostors() {
+	glGenTextures(1,&impostor_atlas_id);
+	glBindTexture(GL_TEXTURE_2D, impostor_atlas_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glGenRenderbuffers(1,&impostor_depth_id);
+	glBindRenderbuffer(GL_RENDERBUFFER, impostor_depth_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE);
+	glGenFramebuffers(1,&impostor_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, impostor_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostor_atlas_id, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, impostor_depth_id);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("internal error at init_impostors: impostor framebuffer incomplete.\n");
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenVertexArrays(1,&impostor_vao);
+	glBindVertexArray(impostor_vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(0,1);
+	glVertexAttribDivisor(1,1);
+}
+
+// the basis program 8 builds billboards from; dir points from the chunk towards the camera
+void __impostor_basis(vec3 dir, vec3* s, vec3* u) {
+	vec3 up = fabsf(dir.y) > .99f ? (vec3){ 0,0,1 } : (vec3){ 0,1,0 };
+	*s = __normalize_vec3(__cross_vec3(up, dir));
+	*u = __cross_vec3(dir, *s);
+}
+
+// render a chunk's full mesh into its atlas tile, looking along -dir (impostor_fbo and program 3 bound)
+void __capture_impostor(chunk_t* chunk, vec3 dir) {
+	vec3 center = __scale_vec3(__add_vec3(chunk->min, chunk->max), .5f);
+	float radius = __mag_vec3(__sub_vec3(chunk->max, chunk->min)) * .5f;
+	vec3 eye = __add_vec3(center, __scale_vec3(dir, radius*2));
+	vec3 s, u;
+	__impostor_basis(dir, &s, &u);
+	mat4 view = identity();
+	view.m00 = s.x;		view.m01 = s.y;		view.m02 = s.z;		view.m03 = -__dot_vec3(s, eye);
+	view.m10 = u.x;		view.m11 = u.y;		view.m12 = u.z;		view.m13 = -__dot_vec3(u, eye);
+	view.m20 = dir.x;	view.m21 = dir.y;	view.m22 = dir.z;	view.m23 = -__dot_vec3(dir, eye);
+	mat4 proj = orthographic(-radius, radius, -radius, radius, radius, radius*3);
+	float view_data[] = {
+		view.m00, view.m10, view.m20, view.m30,
+		view.m01, view.m11, view.m21, view.m31,
+		view.m02, view.m12, view.m22, view.m32,
+		view.m03, view.m13, view.m23, view.m33
+	};
+	float proj_data[] = {
+		proj.m00, proj.m10, proj.m20, proj.m30,
+		proj.m01, proj.m11, proj.m21, proj.m31,
+		proj.m02, proj.m12, proj.m22, proj.m32,
+		proj.m03, proj.m13, proj.m23, proj.m33
+	};
+	bind_frame_data(view_data, proj_data);
+
+	uint32_t x = (chunk->impostor_tile-1) % IMPOSTOR_TILES_PER_ROW * IMPOSTOR_TILE_SIZE;
+	uint32_t y = (chunk->impostor_tile-1) / IMPOSTOR_TILES_PER_ROW * IMPOSTOR_TILE_SIZE;
+	glViewport(x, y, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+	glScissor(x, y, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+	glEnable(GL_SCISSOR_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	bind_chunk_packing(chunk);
+	draw_pool_range(&chunk->geometry);
+	chunk->impostor_dir = dir;
+	chunk->impostor_valid = 1;
+}
+
+// choose each chunk's level of detail by its distance from eye, and refresh impostor captures
+// (up to IMPOSTOR_CAPTURES_PER_FRAME). frame data must be bound again afterwards.
+void update_chunk_lods(vec3 eye) {
+	if(!impostor_fbo) init_impostors();
+	const float lod_dists[] = { LOD_PROXY_DIST, LOD_IMPOSTOR_DIST };
+	uint32_t n_captures = 0;
+	GLint viewport[4], framebuffer;
+	if(textures_updated) {		// captures may show texture placeholders
+		for(uint32_t i = 0; i < render_world->n_chunks; i++)
+			render_world->chunks[i].impostor_valid = 0;
+		textures_updated = 0;
+	}
+	for(uint32_t i = 0; i < render_world->n_chunks; i++) {
+		chunk_t* chunk = &render_world->chunks[i];
+		if(!chunk->geometry.n_indices) chunk->lod = CHUNK_LOD_FULL;
+		vec3 center = __scale_vec3(__add_vec3(chunk->min, chunk->max), .5f);
+		vec3 to_eye = __sub_vec3(eye, center);
+		float dist = __mag_vec3(to_eye);
+		while(chunk->geometry.n_indices && chunk->lod < CHUNK_LOD_IMPOSTOR && dist > lod_dists[chunk->lod]*(1+LOD_HYSTERESIS))
+			chunk->lod++;
+		while(chunk->lod > CHUNK_LOD_FULL && dist < lod_dists[chunk->lod-1]*(1-LOD_HYSTERESIS))
+			chunk->lod--;
+
+		if(chunk->lod != CHUNK_LOD_IMPOSTOR) {		// give up the atlas tile
+			if(chunk->impostor_tile) impostor_tile_used[chunk->impostor_tile-1] = 0;
+			chunk->impostor_tile = chunk->impostor_valid = 0;
+			continue;
+		}
+		if(!chunk->impostor_tile) {
+			for(uint32_t t = 0; t < IMPOSTOR_TILES_PER_ROW*IMPOSTOR_TILES_PER_ROW; t++)
+				if(!impostor_tile_used[t]) {
+					impostor_tile_used[t] = 1;
+					chunk->impostor_tile = t+1;
+					break;
+				}
+			if(!chunk->impostor_tile) continue;		// atlas full; drawn as a proxy
+		}
+		vec3 dir = __normalize_vec3(to_eye);
+		if(chunk->impostor_valid && __dot_vec3(dir, chunk->impostor_dir) >= IMPOSTOR_ANGLE) continue;
+		if(n_captures == IMPOSTOR_CAPTURES_PER_FRAME) continue;
+		if(!n_captures++) {
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, impostor_fbo);
+			glDisable(GL_BLEND);
+			glClearColor(0,0,0,0);
+			glUseProgram(program_ids[3]);
+			glUniform1i(glGetUniformLocation(program_ids[3],"u_textures"), 0);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+			glBindVertexArray(chunk_pool.vao_id);
+		}
+		__capture_impostor(chunk, dir);
+	}
+	if(n_captures) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glEnable(GL_BLEND);
+	}
+}
+
+// queue a chunk's impostor billboard for draw_impostors
+void __queue_impostor(chunk_t* chunk) {
+	if(n_impostor_instances == max_impostor_instances) {
+		max_impostor_instances = max_impostor_instances ? max_impostor_instances*2 : 64;
+		impostor_instances = realloc(impostor_instances, sizeof(float)*8*max_impostor_instances);
+	}
+	float* instance = &impostor_instances[n_impostor_instances++ * 8];
+	vec3 center = __scale_vec3(__add_vec3(chunk->min, chunk->max), .5f);
+	instance[0] = center.x, instance[1] = center.y, instance[2] = center.z;
+	instance[3] = __mag_vec3(__sub_vec3(chunk->max, chunk->min)) * .5f;
+	instance[4] = chunk->impostor_dir.x, instance[5] = chunk->impostor_dir.y, instance[6] = chunk->impostor_dir.z;
+	instance[7] = chunk->impostor_tile-1;
+}
+
+// draw the queued impostor billboards in one instanced call
+void draw_impostors() {
+	if(!n_impostor_instances) return;
+	uint32_t offset;
+	memcpy(stream_alloc(sizeof(float)*8*n_impostor_instances, &offset), impostor_instances, sizeof(float)*8*n_impostor_instances);
+	stream_flush();
+	glUseProgram(program_ids[8]);
+	glUniform1i(glGetUniformLocation(program_ids[8],"u_atlas"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, impostor_atlas_id);
+	glBindVertexArray(impostor_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream.buffer_id);
+	glVertexAttribPointer(0,4,GL_FLOAT,GL_FALSE,32,(void*)(uintptr_t)offset);
+	glVertexAttribPointer(1,4,GL_FLOAT,GL_FALSE,32,(void*)(uintptr_t)(offset+16));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n_impostor_instances);
+	profile_count(1, n_impostor_instances*2);
+	n_impostor_instances = 0;
+}
+
+// bricks that are not baked or pulled are drawn in two buckets: opaque bricks front to back with
+// blending off, so early depth testing rejects what they hide, then transparent bricks back to
+// front with blending on and depth writes off. with more than WEIGHTED_OIT_THRESHOLD transparent
+// bricks the sort is skipped for weighted blended order-independent transparency: the bricks
+// accumulate into float targets, weighted by alpha and depth, and the average is composited over the
+// scene with program 9. this needs GL_ARB_draw_buffers_blend; otherwise bricks are always sorted.
+
+#define WEIGHTED_OIT_THRESHOLD 1024
+
+// fragment outputs for weighted transparency: with u_weighted set, weigh_output turns final into a
+// weighted premultiplied color for the accumulation target, and writes alpha to the revealage target
+#define WEIGHTED_OIT_BLOCK \
+	"layout(location=1) out vec4 revealage;				\n" \
+	"uniform bool u_weighted;							\n" \
+	"void weigh_output() {								\n" \
+	"	if(!u_weighted) return;							\n" \
+	"	float w = clamp(final.a * 3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);\n" \
+	"	revealage = vec4(final.a);						\n" \
+	"	final = vec4(final.rgb * final.a, final.a) * w;	\n" \
+	"}													\n"
+
+typedef struct bucket_entry_t {
+	uint32_t brick_id;
+	float dist;					// squared distance from the camera
+} bucket_entry_t;
+
+bucket_entry_t* opaque_bucket, *transparent_bucket;
+uint32_t max_bucket_entries;
+
+uint8_t enable_weighted_oit = 1;
+PFNGLBLENDFUNCIPROC blend_func_i;	// 0 if unsupported
+GLuint oit_fbo, oit_accum_id, oit_revealage_id, oit_depth_id, oit_vao;
+GLint oit_width, oit_height;
+GLenum oit_depth_format;
+
+void init_transparency() {
+	if(glfwExtensionSupported("GL_ARB_draw_buffers_blend"))
+		blend_func_i = (PFNGLBLENDFUNCIPROC)glfwGetProcAddress("glBlendFunciARB");
+	glGenVertexArrays(1,&oit_vao);
+}
+
+int __compare_bucket_entries(const void* a, const void* b) {
+	float da = ((const bucket_entry_t*)a)->dist, db = ((const bucket_entry_t*)b)->dist;
+	return (da > db) - (da < db);
+}
+
+// farthest first
+int __compare_bucket_entries_back_to_front(const void* a, const void* b) {
+	return __compare_bucket_entries(b, a);
+}
+
+// draw one brick with program 2, binding its own textures
+void draw_brick_individually(brick_t* brick) {
+	GLuint program_id = program_ids[2];
+	glUseProgram(program_id);
+	mesh_t mesh = meshes[brick->mesh_id];
+
+	GLfloat faces[6];
+	for(uint32_t f = 0; f < 6; f++) {
+		if(brick->texture_ids[f]) {
+			if(brick->repeat_textures[f]) faces[f] = 1;
+			else faces[f] = 2;
+		} else faces[f] = 0;
+	}
+	for(uint32_t f = 0; f < 6; f++) {
+		glActiveTexture(GL_TEXTURE0+f);
+		glBindTexture(GL_TEXTURE_2D,brick->texture_ids[f]);
+	}
+	GLint units[] = { 0,1,2,3,4,5 };
+	glUniform1iv(glGetUniformLocation(program_id,"u_samplers"), 6, units);
+
+	// update uniforms
+	bind_draw_data(brick_model_matrix(brick), brick->color, faces);
+
+	// submit draw call
+	glBindVertexArray(mesh_pool.vao_id);
+	draw_pool_range(&mesh.range);
+	profile_count(1, mesh.range.n_indices/3);
+}
+
+// draw bricks in the given order; indirect batches are flushed before any individual draw
+void __draw_bucket(bucket_entry_t* bucket, uint32_t n) {
+	for(uint32_t i = 0; i < n; i++) {
+		brick_t* brick = &render_world->bricks[bucket[i].brick_id];
+		if(queue_brick_draw(brick)) continue;
+		submit_brick_draws();
+		draw_brick_individually(brick);
+	}
+	submit_brick_draws();
+}
+
+// (re)create the weighted transparency targets for viewports up to width x height, with a depth
+// buffer in the same format as the current framebuffer's so its depth can be blitted over
+void __size_oit_targets(GLint width, GLint height) {
+	GLint framebuffer, depth_size, stencil_size;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, framebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH,
+		GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_size);
+	glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, framebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH,
+		GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_size);
+	GLenum depth_format = stencil_size ? GL_DEPTH24_STENCIL8 : depth_size == 16 ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+	if(oit_fbo && width <= oit_width && height <= oit_height && depth_format == oit_depth_format) return;
+	if(width < oit_width) width = oit_width;		// only grow, as the dynamic resolution viewport changes
+	if(height < oit_height) height = oit_height;
+	if(!oit_fbo) {
+		glGenFramebuffers(1,&oit_fbo);
+		glGenTextures(1,&oit_accum_id);
+		glGenTextures(1,&oit_revealage_id);
+		glGenRenderbuffers(1,&oit_depth_id);
+	}
+	oit_width = width, oit_height = height, oit_depth_format = depth_format;
+	glBindTexture(GL_TEXTURE_2D, oit_accum_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, oit_revealage_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindRenderbuffer(GL_RENDERBUFFER, oit_depth_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, depth_format, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, oit_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, oit_accum_id, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, oit_revealage_id, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, oit_depth_id);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("internal error at __size_oit_targets: weighted transparency framebuffer is incomplete.\n");
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+// accumulate transparent bricks in any order, then composite them over the current framebuffer
+void __draw_weighted_transparent(bucket_entry_t* bucket, uint32_t n) {
+	GLint viewport[4], framebuffer;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	__size_oit_targets(viewport[2], viewport[3]);
+
+	// share the opaque depth, so hidden transparent fragments are rejected
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oit_fbo);
+	glBlitFramebuffer(viewport[0], viewport[1], viewport[0]+viewport[2], viewport[1]+viewport[3],
+		0, 0, viewport[2], viewport[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, oit_fbo);
+	glViewport(0, 0, viewport[2], viewport[3]);
+	GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, draw_buffers);
+	float zero[] = { 0,0,0,0 }, one[] = { 1,1,1,1 };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+	blend_func_i(0, GL_ONE, GL_ONE);
+	blend_func_i(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+	glUseProgram(program_ids[2]);
+	glUniform1i(glGetUniformLocation(program_ids[2],"u_weighted"), 1);
+	glUseProgram(program_ids[5]);
+	glUniform1i(glGetUniformLocation(program_ids[5],"u_weighted"), 1);
+	__draw_bucket(bucket, n);
+	glUseProgram(program_ids[2]);
+	glUniform1i(glGetUniformLocation(program_ids[2],"u_weighted"), 0);
+	glUseProgram(program_ids[5]);
+	glUniform1i(glGetUniformLocation(program_ids[5],"u_weighted"), 0);
+
+	// composite
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(program_ids[9]);
+	glUniform1i(glGetUniformLocation(program_ids[9],"u_accum"), 0);
+	glUniform1i(glGetUniformLocation(program_ids[9],"u_revealage"), 1);
+	glUniform2i(glGetUniformLocation(program_ids[9],"u_origin"), viewport[0], viewport[1]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, oit_accum_id);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, oit_revealage_id);
+	glBindVertexArray(oit_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	profile_count(1, 1);
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_DEPTH_TEST);
+}
+
+// draw every brick that is not baked or pulled, opaque then transparent; eye is the camera position.
+// expects blending to be off, and leaves it on.
+void render_loose_bricks(vec3 eye) {
+	brick_list_t* list = brick_render_mode == BRICK_RENDER_PULL ? &unpulled_bricks : &loose_bricks;
+	if(max_bucket_entries < list->n_ids) {
+		max_bucket_entries = list->n_ids;
+		opaque_bucket = realloc(opaque_bucket, sizeof(bucket_entry_t)*max_bucket_entries);
+		transparent_bucket = realloc(transparent_bucket, sizeof(bucket_entry_t)*max_bucket_entries);
+	}
+	uint32_t n_opaque = 0, n_transparent = 0;
+	for(uint32_t j = 0; j < list->n_ids; j++) {
+		uint32_t i = list->ids[j];
+		brick_t* brick = &render_world->bricks[i];
+		if(enable_occlusion_culling && !brick_visibility[i]) continue;
+		vec3 min, max;
+		brick_aabb(brick, &min, &max);
+		vec3 d = __sub_vec3(__scale_vec3(__add_vec3(min, max), .5f), eye);
+		bucket_entry_t entry = { i, __dot_vec3(d, d) };
+		if(brick->color.w < 1) transparent_bucket[n_transparent++] = entry;
+		else opaque_bucket[n_opaque++] = entry;
+	}
+
+	qsort(opaque_bucket, n_opaque, sizeof(bucket_entry_t), __compare_bucket_entries);
+	__draw_bucket(opaque_bucket, n_opaque);
+	glEnable(GL_BLEND);
+	if(!n_transparent) return;
+
+	// without depth writes, back faces would blend over the front ones (the dark bottom.png underside
+	// showing through the top), so only front faces are drawn
+	glDepthMask(GL_FALSE);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	if(enable_weighted_oit && blend_func_i && n_transparent > WEIGHTED_OIT_THRESHOLD)
+		__draw_weighted_transparent(transparent_bucket, n_transparent);
+	else {
+		qsort(transparent_bucket, n_transparent, sizeof(bucket_entry_t), __compare_bucket_entries_back_to_front);
+		__draw_bucket(transparent_bucket, n_transparent);
+	}
+	glDisable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+}
+
+// draw a triangle with each program, with rasterization off, so drivers finish any compilation
+// they defer to the first draw before the first frame
+void warm_up_programs() {
+	GLuint vao_id;
+	glGenVertexArrays(1,&vao_id);
+	glBindVertexArray(vao_id);
+	float zero[16] = { 0 };
+	vec4 color = { 0,0,0,0 };
+	bind_frame_data(zero, zero);
+	bind_draw_data(identity(), color, 0);
+	glUseProgram(program_ids[4]);		// its buffer textures can't share unit 0 with its texture array
+	glUniform1i(glGetUniformLocation(program_ids[4],"u_records"), 1);
+	glUniform1i(glGetUniformLocation(program_ids[4],"u_visible"), 2);
+	glEnable(GL_RASTERIZER_DISCARD);
+	for(uint32_t i = 0; i < n_programs; i++) {
+		glUseProgram(program_ids[i]);
+		glDrawArrays(GL_TRIANGLES,0,3);
+	}
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1,&vao_id);
+}
+
+void init_render() {	// setup and set shader program, GL states
+	// setup depth test, blending
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	init_stream();
+	init_program_cache();
+	init_gpu_culling();
+
+	const char* vtx_shader_src_1 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"
+	FRAME_DATA_BLOCK
+	DRAW_DATA_BLOCK
+	"void main() {										\n"	
+	"	gl_Position = u_proj * u_view * u_model * vec4(vtx_pos,1);	\n"
+	"}													";
+
+	const char* pxl_shader_src_1 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	DRAW_DATA_BLOCK
+	"void main() {										\n"
+	"	final = u_color;\n"
+	"}													";
+
+	create_program(vtx_shader_src_1, pxl_shader_src_1);
+
+	const char* vtx_shader_src_2 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"
+	"layout(location=1) in vec3 vtx_norm;				\n"
+	"out vec3 pxl_norm;									\n"
+	"out vec3 pxl_pos;									\n"
+	FRAME_DATA_BLOCK
+	DRAW_DATA_BLOCK
+	"void main() {										\n"	
+	"	pxl_norm = mat3(transpose(inverse(u_model))) * vtx_norm;\n"
+	"	pxl_pos = vec3(u_model * vec4(vtx_pos,1.0));	\n"
+	"	gl_Position = u_proj * u_view * u_model * vec4(vtx_pos,1);\n"
+	"}													";
+
+	const char* pxl_shader_src_2 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"in vec3 pxl_norm;									\n"
+	"in vec3 pxl_pos;									\n"
+	DRAW_DATA_BLOCK
+	"void main() {										\n"
+	"	vec3 light_pos = vec3(75,50,50);				\n"
+	"	vec3 light_col = vec3(.6,.6,.6);				\n"
+	"	vec3 norm = normalize(pxl_norm);				\n"	
+	//"	vec3 light_dir = normalize(light_pos - pxl_pos);\n"			// from light position to object (point light)
+	"	vec3 light_dir = normalize(-vec3(-0.2f, -1.0f, -1.5f));\n"	// directional light
+	"	float diff = max(dot(norm, light_dir), 0.0);	\n"
+	"	vec3 diffuse = diff * light_col;				\n"
+	"	vec3 ambient = vec3(.6,.6,.6);					\n"
+	"	final = vec4(ambient+diffuse,1) * u_color;\n"
+	"}													";
+
+	create_program(vtx_shader_src_2, pxl_shader_src_2);
+
+	const char* vtx_shader_src_3 =
 	"#version 330										\n"
 	"layout(location=0) in vec3 vtx_pos;				\n"
 	"layout(location=1) in vec3 vtx_norm;				\n"
@@ -1028,18 +4529,18 @@ void init_render() {	// setup and set shader program, GL states
 	"out vec3 pxl_pos;									\n"
 	"out vec2 pxl_tex;									\n"
 	"flat out uint face_id;								\n"
-	"uniform float u_textured_faces[6];					\n"
-	"uniform mat4 u_model, u_view, u_proj;				\n"
+	FRAME_DATA_BLOCK
+	DRAW_DATA_BLOCK
 	"void main() {										\n"	
 	"	pxl_norm = mat3(transpose(inverse(u_model))) * vtx_norm;\n"
 	"	pxl_pos = vec3(u_model * vec4(vtx_pos,1.0));	\n"
 	"	pxl_tex = vtx_tex;								\n"
 	"	face_id = uint(gl_VertexID/4);					\n"
-	"	if((face_id == 1u || face_id == 3u) && u_textured_faces[face_id] == 1.0) {			\n"	// top/bottom face - scale tex coords by x,z
+	"	if((face_id == 1u || face_id == 3u) && u_textured_faces[face_id/4u][face_id%4u] == 1.0) {			\n"	// top/bottom face - scale tex coords by x,z
 	"		pxl_tex.x *= u_model[2][2];					\n"
 	"		pxl_tex.y *= u_model[0][0];					\n"
 	"	}												\n"
-	"	if((face_id == 4u || face_id == 5u) && u_textured_faces[face_id] == 1.0) {			\n"	// left/right face - scale tex coords by y,z
+	"	if((face_id == 4u || face_id == 5u) && u_textured_faces[face_id/4u][face_id%4u] == 1.0) {			\n"	// left/right face - scale tex coords by y,z
 	"		pxl_tex.x *= u_model[1][1];					\n"
 	"		pxl_tex.y *= u_model[2][2];					\n"
 	"	}												\n"
@@ -1054,49 +4555,525 @@ void init_render() {	// setup and set shader program, GL states
 	"	gl_Position = u_proj * u_view * u_model * vec4(vtx_pos,1);\n"
 	"}													";
 
-	const char* pxl_shader_src_3 =
+	const char* pxl_shader_src_3 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"in vec3 pxl_norm;									\n"
+	"in vec3 pxl_pos;									\n"
+	"in vec2 pxl_tex;									\n"
+	"flat in uint face_id;								\n"
+	DRAW_DATA_BLOCK
+	"uniform sampler2D u_samplers[6];					\n"
+	FRAME_DATA_BLOCK
+	CLUSTERED_LIGHTS_BLOCK
+	WEIGHTED_OIT_BLOCK
+	"void main() {										\n"
+	"	vec3 light_col = vec3(.6,.6,.6);				\n"
+	"	vec3 norm = normalize(pxl_norm);				\n"	
+	"	vec3 light_dir = normalize(-vec3(-0.2f, -1.0f, -1.5f));\n"	// directional light
+	"	float diff = max(dot(norm, light_dir), 0.0);	\n"
+	"	vec3 diffuse = diff * light_col;				\n"
+	"	vec3 ambient = vec3(.6,.6,.6);					\n"
+	"	final = vec4(ambient+diffuse+point_lights(pxl_pos, norm),1) * u_color;\n"
+	"	if(u_textured_faces[face_id/4u][face_id%4u]>0.0) {\n"
+	"		vec4 sample;								\n"
+	"		if(face_id == 0.) sample = texture(u_samplers[0],pxl_tex);\n"
+	"		if(face_id == 1.) sample = texture(u_samplers[1],pxl_tex);\n"
+	"		if(face_id == 2.) sample = texture(u_samplers[2],pxl_tex);\n"
+	"		if(face_id == 3.) sample = texture(u_samplers[3],pxl_tex);\n"
+	"		if(face_id == 4.) sample = texture(u_samplers[4],pxl_tex);\n"
+	"		if(face_id == 5.) sample = texture(u_samplers[5],pxl_tex);\n"
+	"		final = sample + (final*(1.0-sample.w));	\n"
+	"	}												\n"
+	"	weigh_output();									\n"
+	"}													";
+
+	create_program(vtx_shader_src_3, pxl_shader_src_3);
+
+	const char* vtx_shader_src_4 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"	// packed_chunk_vertex_t
+	"layout(location=1) in vec2 vtx_norm;				\n"	// octahedral
+	"layout(location=2) in vec2 vtx_tex;				\n"
+	"layout(location=3) in vec3 vtx_color;				\n"
+	"layout(location=4) in float vtx_layer;				\n"	// layer + 64*ao
+	"out vec3 pxl_norm;									\n"
+	"out vec2 pxl_tex;									\n"
+	"out vec4 pxl_color;								\n"
+	"out vec3 pxl_pos;									\n"
+	"out float pxl_ao;									\n"
+	"flat out float pxl_layer;							\n"
+	"uniform vec3 u_chunk_origin;						\n"	// center of the chunk's region
+	"uniform vec2 u_chunk_steps;						\n"	// position step, texture coordinate step
+	FRAME_DATA_BLOCK
+	"void main() {										\n"
+	"	vec3 n = vec3(vtx_norm, 1.0-abs(vtx_norm.x)-abs(vtx_norm.y));\n"
+	"	if(n.z < 0.0) n.xy = (1.0-abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));\n"
+	"	pxl_norm = n;									\n"	// baked in world space
+	"	pxl_tex = vtx_tex*u_chunk_steps.y;				\n"
+	"	pxl_color = vec4(vtx_color,1);					\n"
+	"	pxl_ao = floor(vtx_layer/64.0);					\n"
+	"	pxl_layer = vtx_layer - pxl_ao*64.0;			\n"
+	"	vec3 pos = u_chunk_origin + vtx_pos*u_chunk_steps.x;\n"
+	"	pxl_pos = pos;									\n"
+	"	gl_Position = u_proj * u_view * vec4(pos,1);	\n"
+	"}													";
+
+	const char* pxl_shader_src_4 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"in vec3 pxl_norm;									\n"
+	"in vec2 pxl_tex;									\n"
+	"in vec4 pxl_color;									\n"
+	"in vec3 pxl_pos;									\n"
+	"in float pxl_ao;									\n"
+	"flat in float pxl_layer;							\n"
+	"uniform sampler2DArray u_textures;					\n"
+	FRAME_DATA_BLOCK
+	CLUSTERED_LIGHTS_BLOCK
+	WEIGHTED_OIT_BLOCK
+	"void main() {										\n"
+	"	vec3 light_col = vec3(.6,.6,.6);				\n"
+	"	vec3 norm = normalize(pxl_norm);				\n"
+	"	vec3 light_dir = normalize(-vec3(-0.2f, -1.0f, -1.5f));\n"	// directional light
+	"	float diff = max(dot(norm, light_dir), 0.0);	\n"
+	"	vec3 diffuse = diff * light_col;				\n"
+	"	float ao = 1.0 - pxl_ao/6.0;					\n"	// baked ambient occlusion (textures are unlit, so they get it too)
+	"	vec3 ambient = vec3(.6,.6,.6) * ao;				\n"
+	"	final = vec4(ambient+diffuse+point_lights(pxl_pos, norm),1) * pxl_color;\n"
+	"	if(pxl_layer > 0.0) {							\n"
+	"		vec4 sample = texture(u_textures, vec3(pxl_tex, pxl_layer-1.0));\n"
+	"		final = vec4(sample.rgb*ao, sample.w) + (final*(1.0-sample.w));\n"
+	"	}												\n"
+	"	weigh_output();									\n"
+	"}													";
+
+	create_program(vtx_shader_src_4, pxl_shader_src_4);
+	chunk_origin_loc = glGetUniformLocation(program_ids[3], "u_chunk_origin");
+	chunk_steps_loc = glGetUniformLocation(program_ids[3], "u_chunk_steps");
+
+	// the cube's corners, normals and texture coordinates are embedded from cube_vbo_data
+	char cube_arrays[4096];
+	uint32_t len = 0;
+	const char* names[] = { "const vec3 cube_pos[24] = vec3[24](", "const vec3 cube_norm[24] = vec3[24](", "const vec2 cube_tex[24] = vec2[24](" };
+	for(uint32_t a = 0; a < 3; a++) {
+		len += sprintf(cube_arrays+len, "%s", names[a]);
+		for(uint32_t v = 0; v < 24; v++) {
+			const float* d = &cube_vbo_data[v*8 + a*3];
+			if(a < 2) len += sprintf(cube_arrays+len, "vec3(%g,%g,%g)%s", d[0], d[1], d[2], v < 23 ? "," : ");\n");
+			else len += sprintf(cube_arrays+len, "vec2(%g,%g)%s", d[0], d[1], v < 23 ? "," : ");\n");
+		}
+	}
+
+	const char* vtx_shader_src_5 =
+	"#version 330										\n"
+	"%s"
+	"const int cube_order[6] = int[6](0,1,2,2,1,3);		\n"
+	"out vec3 pxl_norm;									\n"
+	"out vec2 pxl_tex;									\n"
+	"out vec4 pxl_color;								\n"
+	"out vec3 pxl_pos;									\n"
+	"out float pxl_ao;									\n"
+	"flat out float pxl_layer;							\n"
+	"uniform usamplerBuffer u_records;					\n"	// 2 RGBA32UI texels per brick_record_t
+	"uniform usamplerBuffer u_visible;					\n"	// brick ID per instance
+	"uniform uvec2 u_texture_sets[%d];					\n"	// 4 layers, 2 layers | repeat mask << 16
+	FRAME_DATA_BLOCK
+	"float snorm16(uint v) { return max(float(int(v << 16) >> 16) / 32767.0, -1.0); }\n"
+	"float half_to_float(uint h) {						\n"
+	"	uint e = (h >> 10) & 31u, m = h & 1023u;		\n"
+	"	float v = e == 0u ? float(m) * exp2(-24.0) : float(m | 1024u) * exp2(float(e) - 25.0);\n"
+	"	return (h & 0x8000u) != 0u ? -v : v;			\n"
+	"}													\n"
+	"void main() {										\n"
+	"	int brick = int(texelFetch(u_visible, gl_InstanceID).r);\n"
+	"	uvec4 r0 = texelFetch(u_records, brick*2);		\n"
+	"	uvec4 r1 = texelFetch(u_records, brick*2+1);	\n"
+	"	vec3 pos = uintBitsToFloat(r0.xyz);				\n"
+	"	vec4 q = vec4(snorm16(r1.x & 0xFFFFu), snorm16(r1.x >> 16), snorm16(r1.y & 0xFFFFu), snorm16(r1.y >> 16));\n"
+	"	vec3 s = vec3(half_to_float(r1.z & 0xFFFFu), half_to_float(r1.z >> 16), half_to_float(r1.w & 0xFFFFu));\n"
+	"	uvec2 set = u_texture_sets[r1.w >> 16];			\n"
+	"	mat3 rot = mat3(								\n"	// same as quat_to_mat4, column by column
+	"		1.0-2.0*(q.y*q.y+q.z*q.z), 2.0*(q.x*q.y+q.z*q.w), 2.0*(q.x*q.z-q.y*q.w),\n"
+	"		2.0*(q.x*q.y-q.z*q.w), 1.0-2.0*(q.x*q.x+q.z*q.z), 2.0*(q.y*q.z+q.x*q.w),\n"
+	"		2.0*(q.x*q.z+q.y*q.w), 2.0*(q.y*q.z-q.x*q.w), 1.0-2.0*(q.x*q.x+q.y*q.y));\n"
+	"	int face = gl_VertexID / 6;						\n"
+	"	int v = face*4 + cube_order[gl_VertexID %% 6];	\n"
+	"	vec3 world_pos = rot * (cube_pos[v] * s) + pos;	\n"
+	"	pxl_norm = rot * (cube_norm[v] / s);			\n"
+	"	pxl_color = vec4((uvec4(r0.w) >> uvec4(0u,8u,16u,24u)) & 0xFFu) / 255.0;\n"
+	"	uint layer = face < 4 ? (set.x >> (8*face)) & 0xFFu : (set.y >> (8*(face-4))) & 0xFFu;\n"
+	"	bool repeat = ((set.y >> (16+face)) & 1u) != 0u;\n"
+	"	pxl_layer = float(layer);						\n"
+	"	pxl_ao = 0.0;									\n"
+	"	vec3 diag = vec3(rot[0][0]*s.x, rot[1][1]*s.y, rot[2][2]*s.z);\n"	// model matrix diagonal, as program 2 uses
+	"	pxl_tex = cube_tex[v];							\n"
+	"	if((face == 1 || face == 3) && repeat) pxl_tex *= diag.zx;\n"
+	"	if((face == 4 || face == 5) && repeat) pxl_tex *= diag.yz;\n"
+	"	if(face == 0) pxl_tex *= diag.yx;				\n"
+	"	if(face == 2) pxl_tex *= diag.xy;				\n"
+	"	pxl_pos = world_pos;							\n"
+	"	gl_Position = u_proj * u_view * vec4(world_pos,1);\n"
+	"}													";
+
+	char* vtx_shader_5 = malloc(strlen(vtx_shader_src_5) + len + 16);
+	sprintf(vtx_shader_5, vtx_shader_src_5, cube_arrays, MAX_TEXTURE_SETS);
+	create_program(vtx_shader_5, pxl_shader_src_4);		// same pixel shader as baked chunks
+	free(vtx_shader_5);
+
+	const char* vtx_shader_src_6 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"
+	"layout(location=1) in vec3 vtx_norm;				\n"
+	"layout(location=2) in vec2 vtx_tex;				\n"
+	"layout(location=5) in mat4 inst_model;				\n"	// 5-8
+	"layout(location=9) in vec4 inst_color;				\n"
+	"layout(location=10) in vec4 inst_layers;			\n"	// faces 0-3
+	"layout(location=11) in vec4 inst_extra;			\n"	// layers of faces 4-5, base vertex, repeat mask
+	"out vec3 pxl_norm;									\n"
+	"out vec2 pxl_tex;									\n"
+	"out vec4 pxl_color;								\n"
+	"out vec3 pxl_pos;									\n"
+	"out float pxl_ao;									\n"
+	"flat out float pxl_layer;							\n"
+	FRAME_DATA_BLOCK
+	"void main() {										\n"
+	"	int face = (gl_VertexID - int(inst_extra.z)) / 4;\n"	// as program 2 does, within the mesh
+	"	bool repeat = ((int(inst_extra.w) >> face) & 1) != 0;\n"
+	"	pxl_layer = face < 4 ? inst_layers[face] : face < 6 ? inst_extra[face-4] : 0.0;\n"
+	"	pxl_ao = 0.0;									\n"
+	"	pxl_norm = mat3(transpose(inverse(inst_model))) * vtx_norm;\n"
+	"	pxl_color = inst_color;							\n"
+	"	pxl_tex = vtx_tex;								\n"
+	"	if((face == 1 || face == 3) && repeat) pxl_tex *= vec2(inst_model[2][2], inst_model[0][0]);\n"
+	"	if((face == 4 || face == 5) && repeat) pxl_tex *= vec2(inst_model[1][1], inst_model[2][2]);\n"
+	"	if(face == 0) pxl_tex *= vec2(inst_model[1][1], inst_model[0][0]);\n"
+	"	if(face == 2) pxl_tex *= vec2(inst_model[0][0], inst_model[1][1]);\n"
+	"	pxl_pos = vec3(inst_model * vec4(vtx_pos,1));	\n"
+	"	gl_Position = u_proj * u_view * vec4(pxl_pos,1);\n"
+	"}													";
+
+	create_program(vtx_shader_src_6, pxl_shader_src_4);
+
+	const char* vtx_shader_src_7 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"
+	"layout(location=1) in vec3 inst_min;				\n"
+	"layout(location=2) in vec3 inst_dim;				\n"
+	"layout(location=3) in vec4 inst_color;				\n"
+	"out vec4 pxl_color;								\n"
+	FRAME_DATA_BLOCK
+	"void main() {										\n"
+	"	pxl_color = inst_color;							\n"
+	"	gl_Position = u_proj * u_view * vec4(inst_min + vtx_pos*inst_dim,1);\n"
+	"}													";
+
+	const char* pxl_shader_src_7 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"in vec4 pxl_color;									\n"
+	"void main() {										\n"
+	"	final = pxl_color;								\n"
+	"}													";
+
+	create_program(vtx_shader_src_7, pxl_shader_src_7);
+
+	const char* vtx_shader_src_8 =
+	"#version 330										\n"
+	"layout(location=0) in vec3 vtx_pos;				\n"
+	"layout(location=1) in vec3 vtx_norm;				\n"
+	"layout(location=3) in vec4 inst_pos;				\n"	// w = arms up
+	"layout(location=4) in vec4 inst_quat;				\n"
+	"layout(location=5) in uvec4 inst_colors_0;			\n"	// parts 0-3
+	"layout(location=6) in uvec2 inst_colors_1;			\n"	// parts 4-5
+	"out vec3 pxl_norm;									\n"
+	"out vec2 pxl_tex;									\n"
+	"out vec4 pxl_color;								\n"
+	"out vec3 pxl_pos;									\n"
+	"out float pxl_ao;									\n"
+	"flat out float pxl_layer;							\n"
+	FRAME_DATA_BLOCK
+	"const vec3 part_pos[6] = vec3[6](vec3(-.5,0,-.5), vec3(-2,0,-.5), vec3(1,0,-.5), vec3(-1,-1,-.5), vec3(0,-1,-.5), vec3(-.5,2,-.5));\n"
+	"const vec3 part_scale[6] = vec3[6](vec3(2,2,1), vec3(1,2,1), vec3(1,2,1), vec3(1,2,1), vec3(1,2,1), vec3(2,1,1));\n"
+	"void main() {										\n"
+	"	int part = gl_InstanceID % 6;					\n"
+	"	vec4 q = inst_quat;								\n"
+	"	mat3 rot = mat3(								\n"	// same as quat_to_mat4, column by column
+	"		1.0-2.0*(q.y*q.y+q.z*q.z), 2.0*(q.x*q.y+q.z*q.w), 2.0*(q.x*q.z-q.y*q.w),\n"
+	"		2.0*(q.x*q.y-q.z*q.w), 1.0-2.0*(q.x*q.x+q.z*q.z), 2.0*(q.y*q.z+q.x*q.w),\n"
+	"		2.0*(q.x*q.z+q.y*q.w), 2.0*(q.y*q.z-q.x*q.w), 1.0-2.0*(q.x*q.x+q.y*q.y));\n"
+	"	vec3 offset = part_pos[part];					\n"
+	"	if((part == 1 || part == 2) && inst_pos.w > 0.0) offset.y = .5;\n"
+	"	vec3 s = part_scale[part];						\n"
+	"	uint color = part < 4 ? inst_colors_0[part] : inst_colors_1[part-4];\n"
+	"	pxl_color = vec4((uvec4(color) >> uvec4(0u,8u,16u,24u)) & 0xFFu) / 255.0;\n"
+	"	pxl_norm = rot * (vtx_norm / s);				\n"
+	"	pxl_tex = vec2(0);								\n"
+	"	pxl_layer = 0.0;								\n"
+	"	pxl_ao = 0.0;									\n"
+	"	vec3 world_pos = inst_pos.xyz + rot * (s * (vtx_pos + offset));\n"	// translate part, scale, rotate, translate
+	"	pxl_pos = world_pos;							\n"
+	"	gl_Position = u_proj * u_view * vec4(world_pos,1);\n"
+	"}													";
+
+	create_program(vtx_shader_src_8, pxl_shader_src_4);
+
+	const char* vtx_shader_src_9 =
+	"#version 330										\n"
+	"layout(location=0) in vec4 inst_center;			\n"	// w = radius
+	"layout(location=1) in vec4 inst_dir;				\n"	// capture direction; w = atlas tile
+	"out vec2 pxl_tex;									\n"
+	FRAME_DATA_BLOCK
+	"void main() {										\n"
+	"	vec3 f = inst_dir.xyz;							\n"	// same basis as __impostor_basis
+	"	vec3 up = abs(f.y) > .99 ? vec3(0,0,1) : vec3(0,1,0);\n"
+	"	vec3 s = normalize(cross(up, f));				\n"
+	"	vec3 u = cross(f, s);							\n"
+	"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+	"	float tile = inst_dir.w;						\n"
+	"	vec2 origin = vec2(mod(tile, %d.0), floor(tile / %d.0));\n"
+	"	pxl_tex = (origin + corner) / %d.0;				\n"
+	"	vec3 pos = inst_center.xyz + (s*(corner.x*2.0-1.0) + u*(corner.y*2.0-1.0)) * inst_center.w;\n"
+	"	gl_Position = u_proj * u_view * vec4(pos,1);	\n"
+	"}													";
+
+	const char* pxl_shader_src_9 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"in vec2 pxl_tex;									\n"
+	"uniform sampler2D u_atlas;							\n"
+	"void main() {										\n"
+	"	vec4 sample = texture(u_atlas, pxl_tex);		\n"
+	"	if(sample.a < .5) discard;						\n"
+	"	final = vec4(sample.rgb, 1);					\n"
+	"}													";
+
+	char* vtx_shader_9 = malloc(strlen(vtx_shader_src_9) + 32);
+	sprintf(vtx_shader_9, vtx_shader_src_9, IMPOSTOR_TILES_PER_ROW, IMPOSTOR_TILES_PER_ROW, IMPOSTOR_TILES_PER_ROW);
+	create_program(vtx_shader_9, pxl_shader_src_9);
+	free(vtx_shader_9);
+
+	const char* vtx_shader_src_10 =
+	"#version 330										\n"
+	"void main() {										\n"
+	"	gl_Position = vec4((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1, 0, 1);\n"
+	"}													";
+
+	const char* pxl_shader_src_10 =
+	"#version 330										\n"
+	"layout(location=0) out vec4 final;					\n"
+	"uniform sampler2D u_accum;							\n"
+	"uniform sampler2D u_revealage;						\n"
+	"uniform ivec2 u_origin;							\n"	// viewport origin
+	"void main() {										\n"
+	"	ivec2 p = ivec2(gl_FragCoord.xy) - u_origin;	\n"
+	"	float revealage = texelFetch(u_revealage, p, 0).r;\n"
+	"	if(revealage >= 1.0) discard;					\n"
+	"	vec4 accum = texelFetch(u_accum, p, 0);			\n"
+	"	final = vec4(accum.rgb / max(accum.a, 1e-5), 1.0 - revealage);\n"
+	"}													";
+
+	create_program(vtx_shader_src_10, pxl_shader_src_10);
+
+	const char* vtx_shader_src_11 =
+	"#version 330										\n"
+	"out vec2 pxl_world;								\n"	// world x,z
+	"uniform vec2 u_center;								\n"
+	"uniform float u_extent;							\n"	// half the width of the area shown
+	"void main() {										\n"
+	"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+	"	pxl_world = u_center + vec2(corner.x, -corner.y) * u_extent;\n"	// north (-z) is up
+	"	gl_Position = vec4(corner, 0, 1);				\n"
+	"}													";
+
+	const char* pxl_shader_src_11 =
 	"#version 330										\n"
 	"layout(location=0) out vec4 final;					\n"
-	"in vec3 pxl_norm;									\n"
-	"in vec3 pxl_pos;									\n"
-	"in vec2 pxl_tex;									\n"
-	"flat in uint face_id;								\n"
-	"uniform vec4 u_color;								\n"
-	"uniform float u_textured_faces[6];					\n"
-	"uniform sampler2D u_samplers[6];					\n"
+	"in vec2 pxl_world;									\n"
+	"uniform sampler2D u_map_color;						\n"
+	"uniform sampler2D u_map_height;					\n"
+	"uniform vec2 u_center;								\n"
+	"uniform float u_extent;							\n"
+	"uniform float u_map_size;							\n"	// world units the tiles span; they wrap around
+	"uniform float u_eye_height;						\n"
 	"void main() {										\n"
-	"	vec3 light_col = vec3(.6,.6,.6);				\n"
-	"	vec3 norm = normalize(pxl_norm);				\n"	
-	"	vec3 light_dir = normalize(-vec3(-0.2f, -1.0f, -1.5f));\n"	// directional light
-	"	float diff = max(dot(norm, light_dir), 0.0);	\n"
-	"	vec3 diffuse = diff * light_col;				\n"
-	"	vec3 ambient = vec3(.6,.6,.6);					\n"
-	"	final = vec4(ambient+diffuse,1) * u_color;		\n"
-	"	if(u_textured_faces[face_id]>0.0) { 			\n"
-	"		vec4 sample;								\n"
-	"		if(face_id == 0.) sample = texture(u_samplers[0],pxl_tex);\n"
-	"		if(face_id == 1.) sample = texture(u_samplers[1],pxl_tex);\n"
-	"		if(face_id == 2.) sample = texture(u_samplers[2],pxl_tex);\n"
-	"		if(face_id == 3.) sample = texture(u_samplers[3],pxl_tex);\n"
-	"		if(face_id == 4.) sample = texture(u_samplers[4],pxl_tex);\n"
-	"		if(face_id == 5.) sample = texture(u_samplers[5],pxl_tex);\n"
-	"		final = sample + (final*(1.0-sample.w));	\n"
-	"	}												\n"
+	"	vec2 tex = pxl_world / u_map_size;				\n"
+	"	vec4 color = texture(u_map_color, tex);			\n"
+	"	float height = texture(u_map_height, tex).r;	\n"
+	"	float shade = clamp(1.0 + (height-u_eye_height)/32.0, .5, 1.3);\n"	// higher tops are brighter
+	"	final = color.a > 0.0 ? vec4(color.rgb*shade, .9) : vec4(0,0,0,.5);\n"
+	"	if(length(pxl_world-u_center) < u_extent*.03) final = vec4(1);\n"	// the camera
 	"}													";
 
-	create_program(vtx_shader_src_3, pxl_shader_src_3);
+	create_program(vtx_shader_src_11, pxl_shader_src_11);
+	init_lighting();
+	const uint32_t lit_programs[] = { 2,3,4,5,7 };
+	for(uint32_t i = 0; i < sizeof(lit_programs)/sizeof(uint32_t); i++)
+		set_light_samplers(program_ids[lit_programs[i]]);
+	warm_up_programs();
+	init_brick_draws();
+	init_transparency();
 }
 
-void render(uint8_t render_entities) {
-	// get all needed uniform IDs from shader program
-	GLuint program_id = program_ids[2];
+// draw every baked chunk that passes occlusion culling, at its level of detail
+void render_chunks() {
+	GLuint program_id = program_ids[3];
+	glUseProgram(program_id);
+	glUniform1i(glGetUniformLocation(program_id,"u_textures"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+	glBindVertexArray(chunk_pool.vao_id);
+
+	for(uint32_t i = 0; i < render_world->n_chunks; i++) {
+		chunk_t* chunk = &render_world->chunks[i];
+		if(!chunk->geometry.n_indices) continue;
+		if(enable_occlusion_culling && !occlusion_test_aabb(chunk->min, chunk->max)) continue;
+		if(chunk->lod == CHUNK_LOD_IMPOSTOR && chunk->impostor_valid) {
+			__queue_impostor(chunk);
+			continue;
+		}
+		bind_chunk_packing(chunk);
+		if(chunk->lod != CHUNK_LOD_FULL) {		// also impostors not captured yet
+			draw_pool_range(&chunk->proxy);
+			profile_count(1, chunk->proxy.n_indices/3);
+			continue;
+		}
+		draw_pool_range(&chunk->geometry);
+		profile_count(1, chunk->geometry.n_indices/3);
+	}
+	draw_impostors();
+}
+
+// draw every brick with a record in one instanced call (BRICK_RENDER_PULL), seen with view_proj;
+// call after update_pull_records
+void render_pulled_bricks(mat4 view_proj) {
+	// list the bricks to draw this frame, on the GPU if possible
+	uint32_t n_visible = 0;
+	if(dispatch_compute)
+		cull_pulled_bricks(view_proj);
+	else {
+		if(max_pull_visible < render_world->n_bricks) {
+			max_pull_visible = render_world->n_bricks;
+			pull_visible = realloc(pull_visible, sizeof(uint32_t)*max_pull_visible);
+		}
+		for(uint32_t i = 0; i < render_world->n_bricks; i++)
+			if(pull_flags[i] && !render_world->bricks[i].deleted && (!enable_occlusion_culling || brick_visibility[i]))
+				pull_visible[n_visible++] = i;
+		if(!n_visible) return;
+		glBindBuffer(GL_TEXTURE_BUFFER, pull_index_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t)*n_visible, pull_visible, GL_STREAM_DRAW);
+	}
+
+	GLuint program_id = program_ids[4];
 	glUseProgram(program_id);
-	GLint model_loc = glGetUniformLocation(program_id,"u_model");
-	GLint view_loc = glGetUniformLocation(program_id,"u_view");
-	GLint proj_loc = glGetUniformLocation(program_id,"u_proj");
-	GLint color_loc = glGetUniformLocation(program_id,"u_color");
-	GLint faces_loc = glGetUniformLocation(program_id,"u_textured_faces");
-	GLint samplers_loc = glGetUniformLocation(program_id,"u_samplers");
+	GLuint sets[MAX_TEXTURE_SETS*2];
+	for(uint32_t i = 0; i < n_texture_sets; i++) {
+		uint8_t* l = texture_sets[i].layers;
+		sets[i*2] = l[0] | l[1] << 8 | l[2] << 16 | (GLuint)l[3] << 24;
+		sets[i*2+1] = l[4] | l[5] << 8 | texture_sets[i].repeat_mask << 16;
+	}
+	if(n_texture_sets) glUniform2uiv(glGetUniformLocation(program_id,"u_texture_sets"), n_texture_sets, sets);
+	glUniform1i(glGetUniformLocation(program_id,"u_textures"), 0);
+	glUniform1i(glGetUniformLocation(program_id,"u_records"), 1);
+	glUniform1i(glGetUniformLocation(program_id,"u_visible"), 2);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array_id);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, pull_record_tex);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, pull_index_tex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, pull_index_buffer);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindVertexArray(pull_vao);
+	if(dispatch_compute) {		// the instance count never comes back to the CPU
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull_command_buffer);
+		draw_arrays_indirect(GL_TRIANGLES, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		profile_count(1, 0);
+		return;
+	}
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 36, n_visible);
+	profile_count(1, n_visible*12);
+}
+
+// draw every humanoid entity in one instanced call. the six body part offsets and scales are
+// constants in program 7; each entity is one humanoid_instance_t, read by six consecutive
+// instances of the default mesh (attribute divisor 6), one per part.
+
+typedef struct humanoid_instance_t {
+	float pos[3];
+	float arms_up;				// 1 if jumping or falling
+	float quat[4];
+	uint32_t colors[6];			// RGBA8; torso, left arm, right arm, left leg, right leg, head
+} humanoid_instance_t;
+
+GLuint humanoid_vao;
+
+void render_humanoids(humanoid_instance_t* instances, uint32_t n) {
+	if(!humanoid_vao) {
+		glGenVertexArrays(1,&humanoid_vao);
+		glBindVertexArray(humanoid_vao);
+		glBindBuffer(GL_ARRAY_BUFFER,mesh_pool.vbo_id);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh_pool.ibo_id);
+		glVertexAttribPointer(0,3,GL_HALF_FLOAT,GL_FALSE,sizeof(packed_vertex_t),(void*)offsetof(packed_vertex_t,pos));
+		glVertexAttribPointer(1,4,GL_INT_2_10_10_10_REV,GL_TRUE,sizeof(packed_vertex_t),(void*)offsetof(packed_vertex_t,norm));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		for(uint32_t a = 3; a < 7; a++) {
+			glEnableVertexAttribArray(a);
+			glVertexAttribDivisor(a,6);
+		}
+	}
+	if(!n) return;
+
+	uint32_t offset;
+	memcpy(stream_alloc(sizeof(humanoid_instance_t)*n, &offset), instances, sizeof(humanoid_instance_t)*n);
+	stream_flush();
+	glUseProgram(program_ids[7]);
+	glBindVertexArray(humanoid_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream.buffer_id);
+	GLsizei stride = sizeof(humanoid_instance_t);
+	glVertexAttribPointer(3,4,GL_FLOAT,GL_FALSE,stride,(void*)(uintptr_t)offset);
+	glVertexAttribPointer(4,4,GL_FLOAT,GL_FALSE,stride,(void*)(uintptr_t)(offset+16));
+	glVertexAttribIPointer(5,4,GL_UNSIGNED_INT,stride,(void*)(uintptr_t)(offset+32));
+	glVertexAttribIPointer(6,2,GL_UNSIGNED_INT,stride,(void*)(uintptr_t)(offset+48));
+	pool_range_t* range = &meshes[0].range;
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range->n_indices, range->index_type, (void*)(uintptr_t)(range->first_slot*4), n*6, range->base_vertex);
+	profile_count(1, range->n_indices/3*n*6);
+}
+
+typedef struct wire_box_t {
+	float min[3], dim[3];
+	uint32_t color;				// RGBA8, as pack_color
+} wire_box_t;
+
+// everything the render thread needs from the simulation for a frame, filled on the main thread by
+// submit_render_packet. brick and light updates are applied to render_world before the frame is drawn
+typedef struct render_packet_t {
+	uint8_t quit;				// stop the render thread instead of drawing
+	uint32_t frame;
+	uint8_t capture;			// capture this frame (F2)
+	render_settings_t settings;
+	mat4 view;
+	vec3 eye;					// camera position
+	uint32_t n_bricks;			// bricks in the world
+	brick_t* bricks;			// new state of each brick in brick_ids
+	uint32_t* brick_ids;
+	uint8_t* brick_edited;		// per update; 0 if the brick only moved, and needn't be refiled
+	uint32_t n_brick_updates, max_brick_updates;
+	point_light_t* lights;		// all of them
+	uint32_t n_lights, max_lights;
+	humanoid_instance_t* humanoids;
+	uint32_t n_humanoids, max_humanoids;
+	wire_box_t* boxes;			// overlays
+	uint32_t n_boxes, max_boxes;
+} render_packet_t;
+
+// draw a frame of the scene as of a render packet
+void render(render_packet_t* packet, uint8_t render_entities) {
+	update_textures();
+	update_chunks();
 
 	mat4 persp = perspective(fovy, window_width/window_height, near, far);
 	float mat_data[] = {
@@ -1105,213 +5082,298 @@ void render(uint8_t render_entities) {
 		persp.m02, persp.m12, persp.m22, persp.m32,
 		persp.m03, persp.m13, persp.m23, persp.m33
 	};
-	glUniformMatrix4fv(proj_loc, 1, GL_FALSE, &mat_data[0]);
-
-	vec3 center = camera_center(player->camera);
-	vec3 up = { 0,1,0 };
-
-	mat4 view;
-	if(!player->focused)
-		view = look_at(player->camera.pos, center, up);
-	else {
-		// update player camera
-		// eye vector should be 10 studs away from player position, in reverse of whichever direction the camera is facing.
-		player->camera.pos = entities[player->entity_id].pos;
-
-		// circle point around the player (XZ plane)
-		vec4 c4 = { 0,0,player->camera.zoom,1 };
-		mat4 rot_matrix = quat_to_mat4(player->camera.quat);
-		c4 = mat4_vec4(rot_matrix, c4);
-		vec3 c3 = { c4.x,c4.y,c4.z };
-		player->camera.pos = __add_vec3(player->camera.pos, c3);
-		player->camera.pos.y += 3;
-
-		center = camera_center(player->camera);
-		view = look_at(player->camera.pos, center, up);
-	}
 
+	mat4 view = packet->view;
 	float view_data[] = {
 		view.m00, view.m10, view.m20, view.m30,
 		view.m01, view.m11, view.m21, view.m31,
 		view.m02, view.m12, view.m22, view.m32,
 		view.m03, view.m13, view.m23, view.m33
 	};
-	glUniformMatrix4fv(view_loc, 1, GL_FALSE, &view_data[0]);
+	if(brick_render_mode == BRICK_RENDER_CHUNKS)
+		update_chunk_lods(packet->eye);
+	update_light_clusters(view, persp);
+	bind_frame_data(view_data, mat_data);
+
+	mat4 view_proj = mat4_mat4(persp, view);
+	if(brick_render_mode == BRICK_RENDER_PULL)
+		update_pull_records();		// before pull_flags and unpulled_bricks are used for this frame
+	if(enable_occlusion_culling)
+		occlusion_cull(view_proj, packet->eye);
+
+	// opaque geometry is drawn with blending off; render_loose_bricks turns it back on for transparent bricks
+	glDisable(GL_BLEND);
 
 	// render all entities.
-	if(render_entities)
-	for(uint32_t i = 0; i < n_entities; i++) {
-		if(!entities[i].is_humanoid) continue;
-		entity_t* entity = &entities[i];
-		GLfloat faces[] = { 0,0,0,0,0,0 };
-		glUniform1fv(faces_loc, 6, faces);
-
-		mesh_t mesh = meshes[0];
-		vec3 p_pos[] = {
-			{-.5, 0,-.5},	// torso
-			{-2,  0,-.5},	// left arm
-			{1,   0,-.5},	// right arm
-			{-1, -1,-.5},	// left leg
-			{0,  -1,-.5},	// right leg
-			{-.5, 2,-.5}	// head
-		};
-		vec3 p_scale[] = {
-			{2,2,1},
-			{1,2,1},
-			{1,2,1},
-			{1,2,1},
-			{1,2,1},
-			{2,1,1}
-		};
+	if(render_entities) {
+		profile_begin(PASS_ENTITIES);
+		render_humanoids(packet->humanoids, packet->n_humanoids);
+		profile_end();
+	}
 
-		if(entity->jump_state == 1 && entity->fall_distance > 6) {	// falling or jumping
-			p_pos[1].y = .5;
-			p_pos[2].y = .5;
-		}
-
-		for(uint32_t j = 0; j < 6; j++) {
-			// calculate model matrix
-			mat4 smat = scale(p_scale[j]);
-			mat4 rmat = quat_to_mat4(entity->quat);
-			// translate parts to their correct position in object space,
-			// then scale, then rotate, then translate to where the player is in the world.
-			mat4 tmat = translate(p_pos[j]);
-			mat4 model = mat4_mat4(rmat,smat);	// scale, then rotate
-			model = mat4_mat4(model,tmat);	// translate parts to where they should be
-			tmat = translate(entity->pos);
-			model = mat4_mat4(tmat,model);		// apply translation
-			float mat_data[] = {
-				model.m00, model.m10, model.m20, model.m30,
-				model.m01, model.m11, model.m21, model.m31,
-				model.m02, model.m12, model.m22, model.m32,
-				model.m03, model.m13, model.m23, model.m33
-			};
-
-			// update uniforms
-			glUniform4f(color_loc, entity->part_colors[j].x, entity->part_colors[j].y, entity->part_colors[j].z, entity->part_colors[j].w);
-			glUniformMatrix4fv(model_loc, 1, GL_FALSE, &mat_data[0]);
-
-			// submit draw call
-			glBindVertexArray(mesh.vao_id);
-			glBindBuffer(GL_ARRAY_BUFFER,mesh.vbo_id);
-			if(mesh.has_ibo) {
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh.ibo_id);
-				glDrawElements(GL_TRIANGLES,mesh.n_indices,GL_UNSIGNED_SHORT,0);
-			} else
-				glDrawArrays(GL_TRIANGLES,0,mesh.n_indices);
-		}
-	}
-
-	// render all bricks.
-	for(uint32_t i = 0; i < world->n_bricks; i++) {
-		if(world->bricks[i].deleted) continue;
-		brick_t brick = world->bricks[i];
-		mesh_t mesh = meshes[brick.mesh_id];
-
-		GLfloat faces[6];
-		for(uint32_t f = 0; f < 6; f++) {
-			if(brick.texture_ids[f]) {
-				if(brick.repeat_textures[f]) faces[f] = 1;
-				else faces[f] = 2;
-			} else faces[f] = 0;
-		}
-		glUniform1fv(faces_loc, 6, faces);
-		for(uint32_t f = 0; f < 6; f++) {
-			glActiveTexture(GL_TEXTURE0+f);
-			glBindTexture(GL_TEXTURE_2D,brick.texture_ids[f]);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		}
-		GLint units[] = { 0,1,2,3,4,5 };
-		glUniform1iv(samplers_loc, 6, units);
-
-		// calculate model matrix
-		mat4 smat = scale(brick.scale);
-		mat4 rmat = quat_to_mat4(brick.quat);
-		mat4 tmat = translate(brick.pos);
-		mat4 model = mat4_mat4(rmat,smat);	// scale, then rotate
-		model = mat4_mat4(tmat,model);		// apply translation
-		float mat_data[] = {
-			model.m00, model.m10, model.m20, model.m30,
-			model.m01, model.m11, model.m21, model.m31,
-			model.m02, model.m12, model.m22, model.m32,
-			model.m03, model.m13, model.m23, model.m33
-		};
+	// render static bricks (baked into chunks, or pulled), then every other brick
+	profile_begin(PASS_STATIC_BRICKS);
+	if(brick_render_mode == BRICK_RENDER_PULL) render_pulled_bricks(view_proj);
+	else render_chunks();
+	profile_end();
+	profile_begin(PASS_LOOSE_BRICKS);
+	render_loose_bricks(packet->eye);
+	profile_end();
+
+	// occluders for the next frame's GPU culling
+	if(dispatch_compute && brick_render_mode == BRICK_RENDER_PULL && enable_occlusion_culling)
+		build_depth_pyramid(view_proj);
+	else hiz_valid = 0;
+}
 
-		// update uniforms
-		glUniform4f(color_loc, brick.color.x, brick.color.y, brick.color.z, brick.color.w);
-		glUniformMatrix4fv(model_loc, 1, GL_FALSE, &mat_data[0]);
+// a unit cube's 12 edges, for wireframe boxes
+const float wire_cube_vbo_data[] = { 0,0,0, 1,0,0, 0,1,0, 1,1,0, 0,0,1, 1,0,1, 0,1,1, 1,1,1 };
+const uint16_t wire_cube_ibo_data[] = {
+	0,1, 2,3, 4,5, 6,7,			// along x
+	0,2, 1,3, 4,6, 5,7,			// along y
+	0,4, 1,5, 2,6, 3,7 };		// along z
 
-		// submit draw call
-		glBindVertexArray(mesh.vao_id);
-		glBindBuffer(GL_ARRAY_BUFFER,mesh.vbo_id);
-		if(mesh.has_ibo) {
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh.ibo_id);
-			glDrawElements(GL_TRIANGLES,mesh.n_indices,GL_UNSIGNED_SHORT,0);
-		} else
-			glDrawArrays(GL_TRIANGLES,0,mesh.n_indices);
+#define WIRE_BOX_BATCH 16384	// boxes per draw; keeps a batch well inside a stream segment
+
+// overlays (the physics wireframe, the placement preview and the selection highlight) are recorded
+// as wireframe boxes on the main thread by record_overlay, and drawn together by render_overlay after
+// the scene; input handling only changes the state they are recorded from
+
+GLuint wire_cube_vao;
+wire_box_t* overlay_boxes;		// recorded for the next render packet
+uint32_t n_overlay_boxes, max_overlay_boxes;
+
+// record a wireframe box for render_overlay
+void overlay_box(vec3 min, vec3 dim, vec4 color) {
+	if(n_overlay_boxes == max_overlay_boxes) {
+		max_overlay_boxes = max_overlay_boxes ? max_overlay_boxes*2 : 256;
+		overlay_boxes = realloc(overlay_boxes, sizeof(wire_box_t)*max_overlay_boxes);
 	}
+	wire_box_t* box = &overlay_boxes[n_overlay_boxes++];
+	memcpy(box->min, &min, sizeof(vec3));
+	memcpy(box->dim, &dim, sizeof(vec3));
+	box->color = pack_color(color);
 }
 
-void render_physics() {
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	// get all needed uniform IDs from shader program
-	glUseProgram(program_ids[0]);
-	GLint model_loc = glGetUniformLocation(program_ids[0],"u_model");
-	GLint view_loc = glGetUniformLocation(program_ids[0],"u_view");
-	GLint proj_loc = glGetUniformLocation(program_ids[0],"u_proj");
-	GLint color_loc = glGetUniformLocation(program_ids[0],"u_color");
+// draw wireframe boxes in one instanced call per batch, with program 6; frame data must already be bound
+void draw_wire_boxes(wire_box_t* boxes, uint32_t n_boxes) {
+	if(!wire_cube_vao) {
+		GLuint buffers[2];
+		glGenBuffers(2,buffers);
+		glGenVertexArrays(1,&wire_cube_vao);
+		glBindVertexArray(wire_cube_vao);
+		glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER,sizeof(wire_cube_vbo_data),wire_cube_vbo_data,GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(wire_cube_ibo_data),wire_cube_ibo_data,GL_STATIC_DRAW);
+		glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,12,0);
+		glEnableVertexAttribArray(0);
+		for(uint32_t a = 1; a < 4; a++) {
+			glEnableVertexAttribArray(a);
+			glVertexAttribDivisor(a,1);
+		}
+	}
+	glUseProgram(program_ids[6]);
+	glBindVertexArray(wire_cube_vao);
+	for(uint32_t first = 0; first < n_boxes; first += WIRE_BOX_BATCH) {
+		uint32_t n = n_boxes-first < WIRE_BOX_BATCH ? n_boxes-first : WIRE_BOX_BATCH;
+		uint32_t offset;
+		memcpy(stream_alloc(sizeof(wire_box_t)*n, &offset), &boxes[first], sizeof(wire_box_t)*n);
+		stream_flush();
+		glBindBuffer(GL_ARRAY_BUFFER, stream.buffer_id);
+		glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(wire_box_t),(void*)(uintptr_t)offset);
+		glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(wire_box_t),(void*)(uintptr_t)(offset+12));
+		glVertexAttribPointer(3,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(wire_box_t),(void*)(uintptr_t)(offset+24));
+		glDrawElementsInstanced(GL_LINES,24,GL_UNSIGNED_SHORT,0,n);
+		profile_count(1, n*12);
+	}
+}
 
-	mat4 persp = perspective(fovy, window_width/window_height, near, far);
-	float mat_data[] = {
-		persp.m00, persp.m10, persp.m20, persp.m30,
-		persp.m01, persp.m11, persp.m21, persp.m31,
-		persp.m02, persp.m12, persp.m22, persp.m32,
-		persp.m03, persp.m13, persp.m23, persp.m33
-	};
-	glUniformMatrix4fv(proj_loc, 1, GL_FALSE, &mat_data[0]);
+// record the frame's overlays from the simulation's state (main thread)
+void record_overlay() {
+	vec4 white = { 1,1,1,1 };
+	if(enable_physics_draw)			// all colliders
+		for(uint32_t i = 0; i < world->n_colls; i++)
+			if(!world->colls[i].deleted) overlay_box(world->colls[i].pos, world->colls[i].dim, white);
+	if(player->show_preview)
+		overlay_box(player->preview_pos, player->preview_size, white);
+	int32_t selected = player->selected_brick_id;
+	if(selected != -1 && !world->bricks[selected].deleted) {
+		vec3 min, max, pad = { .02,.02,.02 };
+		vec4 yellow = { 1,1,0,1 };
+		brick_aabb(&world->bricks[selected], &min, &max);
+		overlay_box(__sub_vec3(min, pad), __add_vec3(__sub_vec3(max, min), __scale_vec3(pad, 2)), yellow);
+	}
+}
 
-	vec3 center = camera_center(player->camera);
-	vec3 up = { 0,1,0 };
-	mat4 view = look_at(player->camera.pos, center, up);
-	float view_data[] = {
-		view.m00, view.m10, view.m20, view.m30,
-		view.m01, view.m11, view.m21, view.m31,
-		view.m02, view.m12, view.m22, view.m32,
-		view.m03, view.m13, view.m23, view.m33
-	};
-	glUniformMatrix4fv(view_loc, 1, GL_FALSE, &view_data[0]);
+// draw a render packet's overlays; call after render, whose frame data is still bound
+void render_overlay(render_packet_t* packet) {
+	profile_begin(PASS_OVERLAY);
+	draw_wire_boxes(packet->boxes, packet->n_boxes);
+	profile_end();
+}
 
-	// render all colliders
-	for(uint32_t i = 0; i < world->n_colls; i++) {
-		if(world->colls[i].deleted) continue;
-		collision_t coll = world->colls[i];
-		mesh_t mesh = meshes[0];
-
-		// calculate model matrix
-		mat4 smat = scale(coll.dim);
-		mat4 tmat = translate(coll.pos);	// how much to translate
-		mat4 model = mat4_mat4(tmat,smat);	// scale, then translate
-		float mat_data[] = {
-			model.m00, model.m10, model.m20, model.m30,
-			model.m01, model.m11, model.m21, model.m31,
-			model.m02, model.m12, model.m22, model.m32,
-			model.m03, model.m13, model.m23, model.m33
-		};
 
-		// update uniforms
-		glUniform4f(color_loc, 1,1,1,1);
-		glUniformMatrix4fv(model_loc, 1, GL_FALSE, &mat_data[0]);
+/*==================================================*/
+/*				MINIMAP								*/
+/*==================================================*/
+// a top-down map of the static bricks around the camera, drawn in the top right corner of the
+// window. the map is a MAP_TILES^2 grid of tiles, one per chunk column, in a color texture (RGB of
+// the highest brick top, alpha 0 where there is none) and a height texture (y of that top). tile
+// (tx,tz) lives at (tx,tz) modulo MAP_TILES and the textures repeat, so as the camera moves only
+// the tiles scrolling in are filled, and the map is drawn as one quad at any offset.
+// a tile is rasterized on the CPU from the AABB tops of its static bricks, and only again when
+// a brick in it is added or removed from its chunk (every edit goes through refile_brick).
+
+#define MAP_TILES 8						// tiles per side; the camera's tile and its neighbors are kept
+#define MAP_TILE_TEXELS 32				// texels per tile side
+#define MAP_SIZE (MAP_TILES*MAP_TILE_TEXELS)
+#define MAP_TILE_UPDATES_PER_FRAME 8
+#define MAP_VIEW_TILES 3				// tiles shown on each side of the camera; under MAP_TILES/2
+#define MAP_SCREEN_SIZE 192				// pixels
+#define MAP_SCREEN_MARGIN 16
+
+GLuint map_color_tex, map_height_tex;
+GLuint map_vao;						// empty; the quad's corners come from gl_VertexID
+int32_t map_tile_x[MAP_TILES*MAP_TILES], map_tile_z[MAP_TILES*MAP_TILES];	// chunk column in each slot
+uint8_t map_tile_valid[MAP_TILES*MAP_TILES];
+uint8_t map_colors[MAP_TILE_TEXELS*MAP_TILE_TEXELS*4];		// the tile being rasterized
+uint16_t map_heights[MAP_TILE_TEXELS*MAP_TILE_TEXELS];		// half floats
+float map_tops[MAP_TILE_TEXELS*MAP_TILE_TEXELS];
+
+void init_minimap() {
+	GLuint textures[2];
+	glGenTextures(2,textures);
+	map_color_tex = textures[0], map_height_tex = textures[1];
+	glGenVertexArrays(1,&map_vao);
+	for(uint32_t i = 0; i < 2; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		if(i == 0) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, MAP_SIZE, MAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		else glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, MAP_SIZE, MAP_SIZE, 0, GL_RED, GL_HALF_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+	for(uint32_t i = 0; i < MAP_TILES*MAP_TILES; i++) {
+		map_tile_x[i] = map_tile_z[i] = INT32_MAX;
+		map_tile_valid[i] = 0;
+	}
+	glUseProgram(program_ids[10]);
+	glUniform1i(glGetUniformLocation(program_ids[10],"u_map_color"), 0);
+	glUniform1i(glGetUniformLocation(program_ids[10],"u_map_height"), 1);
+}
+
+uint32_t __map_slot(int32_t tx, int32_t tz) {
+	return (tz - floor_div(tz,MAP_TILES)*MAP_TILES)*MAP_TILES + (tx - floor_div(tx,MAP_TILES)*MAP_TILES);
+}
+
+// mark the tiles under an AABB for rasterizing again (called when a static brick enters or leaves a chunk)
+void minimap_mark_dirty(vec3 min, vec3 max) {
+	if(!map_color_tex) return;
+	int32_t x0 = floorf(min.x/CHUNK_SIZE), x1 = floorf(max.x/CHUNK_SIZE);
+	int32_t z0 = floorf(min.z/CHUNK_SIZE), z1 = floorf(max.z/CHUNK_SIZE);
+	for(int32_t tz = z0; tz <= z1; tz++)
+	for(int32_t tx = x0; tx <= x1; tx++) {
+		uint32_t slot = __map_slot(tx,tz);
+		if(map_tile_x[slot] == tx && map_tile_z[slot] == tz) map_tile_valid[slot] = 0;
+	}
+}
+
+// rasterize the brick tops of a chunk column into its tile
+void __rasterize_map_tile(int32_t tx, int32_t tz) {
+	memset(map_colors, 0, sizeof(map_colors));
+	for(uint32_t i = 0; i < MAP_TILE_TEXELS*MAP_TILE_TEXELS; i++)
+		map_tops[i] = -FLT_MAX;
+
+	// the column's chunks bound the heights to search
+	int32_t cy0 = INT32_MAX, cy1 = INT32_MIN;
+	for(int32_t cy = render_world->chunk_cy_min; render_world->n_chunks && cy <= render_world->chunk_cy_max; cy++) {
+		if(find_chunk(tx,cy,tz) == -1) continue;
+		cy0 = cy < cy0 ? cy : cy0;
+		cy1 = cy;
+	}
+	float texel = (float)CHUNK_SIZE/MAP_TILE_TEXELS;
+	vec3 qmin = { (float)tx*CHUNK_SIZE, (float)cy0*CHUNK_SIZE, (float)tz*CHUNK_SIZE };
+	vec3 qmax = { (tx+1.0f)*CHUNK_SIZE - texel*.5f, (cy1+1.0f)*CHUNK_SIZE, (tz+1.0f)*CHUNK_SIZE - texel*.5f };
+	uint32_t n_ids = cy0 <= cy1 ? query_static_bricks(qmin, qmax) : 0;
+	for(uint32_t i = 0; i < n_ids; i++) {
+		brick_t* brick = &render_world->bricks[query_ids[i]];
+		// texels whose centers are inside the brick's AABB
+		int32_t x0 = ceilf((brick->bake_min.x - qmin.x)/texel - .5f), x1 = floorf((brick->bake_max.x - qmin.x)/texel - .5f);
+		int32_t z0 = ceilf((brick->bake_min.z - qmin.z)/texel - .5f), z1 = floorf((brick->bake_max.z - qmin.z)/texel - .5f);
+		x0 = x0 < 0 ? 0 : x0, z0 = z0 < 0 ? 0 : z0;
+		x1 = x1 >= MAP_TILE_TEXELS ? MAP_TILE_TEXELS-1 : x1, z1 = z1 >= MAP_TILE_TEXELS ? MAP_TILE_TEXELS-1 : z1;
+		float top = brick->bake_max.y;
+		uint32_t color = pack_color(brick->color) | 0xFF000000u;		// alpha marks the texel as covered
+		for(int32_t z = z0; z <= z1; z++)
+		for(int32_t x = x0; x <= x1; x++) {
+			uint32_t t = z*MAP_TILE_TEXELS + x;
+			if(top <= map_tops[t]) continue;
+			map_tops[t] = top;
+			memcpy(&map_colors[t*4], &color, 4);
+		}
+	}
+	for(uint32_t i = 0; i < MAP_TILE_TEXELS*MAP_TILE_TEXELS; i++)
+		map_heights[i] = float_to_half(map_colors[i*4+3] ? map_tops[i] : 0);
+
+	uint32_t slot = __map_slot(tx,tz);
+	GLint x = slot % MAP_TILES * MAP_TILE_TEXELS, y = slot / MAP_TILES * MAP_TILE_TEXELS;
+	glBindTexture(GL_TEXTURE_2D, map_color_tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, MAP_TILE_TEXELS, MAP_TILE_TEXELS, GL_RGBA, GL_UNSIGNED_BYTE, map_colors);
+	glBindTexture(GL_TEXTURE_2D, map_height_tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, MAP_TILE_TEXELS, MAP_TILE_TEXELS, GL_RED, GL_HALF_FLOAT, map_heights);
+}
 
-		// submit draw call
-		glBindVertexArray(mesh.vao_id);
-		glBindBuffer(GL_ARRAY_BUFFER,mesh.vbo_id);
-		if(mesh.has_ibo) {
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,mesh.ibo_id);
-			glDrawElements(GL_TRIANGLES,mesh.n_indices,GL_UNSIGNED_SHORT,0);
-		} else
-			glDrawArrays(GL_TRIANGLES,0,mesh.n_indices);
+// move the tiles to the camera's neighborhood, and rasterize up to MAP_TILE_UPDATES_PER_FRAME
+// tiles that are new or dirty, nearest first
+void update_minimap(vec3 eye) {
+	int32_t ex = floorf(eye.x/CHUNK_SIZE), ez = floorf(eye.z/CHUNK_SIZE);
+	for(int32_t tz = ez - MAP_TILES/2; tz < ez + MAP_TILES/2; tz++)
+	for(int32_t tx = ex - MAP_TILES/2; tx < ex + MAP_TILES/2; tx++) {
+		uint32_t slot = __map_slot(tx,tz);
+		if(map_tile_x[slot] == tx && map_tile_z[slot] == tz) continue;
+		map_tile_x[slot] = tx, map_tile_z[slot] = tz;
+		map_tile_valid[slot] = 0;
 	}
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	uint32_t n_updated = 0;
+	for(int32_t ring = 0; ring <= MAP_TILES/2 && n_updated < MAP_TILE_UPDATES_PER_FRAME; ring++)
+		for(uint32_t slot = 0; slot < MAP_TILES*MAP_TILES && n_updated < MAP_TILE_UPDATES_PER_FRAME; slot++) {
+			int32_t dx = abs(map_tile_x[slot] - ex), dz = abs(map_tile_z[slot] - ez);
+			if(map_tile_valid[slot] || (dx > dz ? dx : dz) != ring) continue;
+			__rasterize_map_tile(map_tile_x[slot], map_tile_z[slot]);
+			map_tile_valid[slot] = 1;
+			n_updated++;
+		}
+}
+
+// update and draw the minimap over the finished frame, in the window's top right corner
+void render_minimap(render_packet_t* packet) {
+	if(!map_color_tex) init_minimap();
+	profile_begin(PASS_MINIMAP);
+	update_minimap(packet->eye);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(window_width - MAP_SCREEN_MARGIN - MAP_SCREEN_SIZE, window_height - MAP_SCREEN_MARGIN - MAP_SCREEN_SIZE,
+		MAP_SCREEN_SIZE, MAP_SCREEN_SIZE);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glUseProgram(program_ids[10]);
+	glUniform2f(glGetUniformLocation(program_ids[10],"u_center"), packet->eye.x, packet->eye.z);
+	glUniform1f(glGetUniformLocation(program_ids[10],"u_extent"), MAP_VIEW_TILES*CHUNK_SIZE);
+	glUniform1f(glGetUniformLocation(program_ids[10],"u_map_size"), MAP_TILES*CHUNK_SIZE);
+	glUniform1f(glGetUniformLocation(program_ids[10],"u_eye_height"), packet->eye.y);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, map_height_tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, map_color_tex);
+	glBindVertexArray(map_vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	profile_count(1, 2);
+	glEnable(GL_DEPTH_TEST);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	profile_end();
 }
 
 
@@ -1345,6 +5407,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		case GLFW_KEY_K: key = 17; break;
 		case GLFW_KEY_O: key = 18; break;
 		case GLFW_KEY_L: key = 19; break;
+		case GLFW_KEY_P: key = 30; break;
+		case GLFW_KEY_F3: key = 31; break;
+		case GLFW_KEY_F2: key = 32; break;
 
 		case GLFW_KEY_1: key = 20; break;
 		case GLFW_KEY_2: key = 21; break;
@@ -1363,6 +5428,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		if(key == 8) enable_physics_draw = !enable_physics_draw;
 		if(key == 9) player->focused = !player->focused;
 		if(key == 10) { vec3 p = {0,0,0}; set_player_pos(p); }
+		if(key == 30) settings.brick_render_mode = settings.brick_render_mode == BRICK_RENDER_PULL ? BRICK_RENDER_CHUNKS : BRICK_RENDER_PULL;
+		if(key == 31) settings.enable_profiler = !settings.enable_profiler;
+		if(key == 32) capture_requested = 1;
 
 		if(key >= 20 && key <= 29)
 			player->selection_colors[player->n_selection_colors++] = key-20;
@@ -1384,7 +5452,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 			color.z = player->selection_colors[2] / 9.;
 			color.w = 1.;
 
-			world->bricks[player->selected_brick_id].color = color;
+			set_brick_color(player->selected_brick_id, color);
 			player->n_selection_colors = 0;
 		}
 	} else if(action == GLFW_RELEASE) kbd[key] = 0;
@@ -1432,7 +5500,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	} else if(action == GLFW_RELEASE) mouse_buttons[button] = 0;
 }
 
-uint8_t prev_rmb;
+uint8_t prev_rmb, prev_mmb;
 void process_input() {
 	if(scroll_y != prev_scroll_y && player->focused)
 		player->camera.zoom = fminf(fmaxf(player->camera.zoom+(prev_scroll_y-scroll_y),5),50);
@@ -1484,59 +5552,21 @@ void process_input() {
 			prev_rmb = 1;
 		} else if(!mouse_buttons[1]) prev_rmb = 0;
 
-		// render outline of potential brick (10 studs in front of camera)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glUseProgram(program_ids[0]);
-		GLint model_loc = glGetUniformLocation(program_ids[0],"u_model");
-		GLint view_loc = glGetUniformLocation(program_ids[0],"u_view");
-		GLint proj_loc = glGetUniformLocation(program_ids[0],"u_proj");
-		GLint color_loc = glGetUniformLocation(program_ids[0],"u_color");
-
-		mat4 persp = perspective(fovy, window_width/window_height, near, far);
-		float mat_data[] = {
-			persp.m00, persp.m10, persp.m20, persp.m30,
-			persp.m01, persp.m11, persp.m21, persp.m31,
-			persp.m02, persp.m12, persp.m22, persp.m32,
-			persp.m03, persp.m13, persp.m23, persp.m33
-		};
-		glUniformMatrix4fv(proj_loc, 1, GL_FALSE, &mat_data[0]);
-
-		vec3 center = camera_center(player->camera);
-		vec3 up = { 0,1,0 };
-		mat4 view = look_at(player->camera.pos, center, up);
-		float view_data[] = {
-			view.m00, view.m10, view.m20, view.m30,
-			view.m01, view.m11, view.m21, view.m31,
-			view.m02, view.m12, view.m22, view.m32,
-			view.m03, view.m13, view.m23, view.m33
-		};
-		glUniformMatrix4fv(view_loc, 1, GL_FALSE, &view_data[0]);
-
-		// render the potential brick
-		mat4 smat = scale(size);
-		mat4 tmat = translate(pos);		// how much to translate
-		mat4 model = mat4_mat4(tmat,smat);	// scale, then translate
-		float mmat_data[] = {
-			model.m00, model.m10, model.m20, model.m30,
-			model.m01, model.m11, model.m21, model.m31,
-			model.m02, model.m12, model.m22, model.m32,
-			model.m03, model.m13, model.m23, model.m33
-		};
-
-		// update uniforms
-		glUniform4f(color_loc, 1,1,1,1);
-		glUniformMatrix4fv(model_loc, 1, GL_FALSE, &mmat_data[0]);
-
-		// submit draw call
-		glBindVertexArray(meshes[0].vao_id);
-		glBindBuffer(GL_ARRAY_BUFFER,meshes[0].vbo_id);
-		if(meshes[0].has_ibo) {
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,meshes[0].ibo_id);
-			glDrawElements(GL_TRIANGLES,meshes[0].n_indices,GL_UNSIGNED_SHORT,0);
-		} else
-			glDrawArrays(GL_TRIANGLES,0,meshes[0].n_indices);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		// middle click - add a lamp brick in the same place
+		if(mouse_buttons[2] && !prev_mmb) {
+			vec4 lamp_color = { 1,.9,.6,1 };
+			vec3 light_color = { 1,.8,.5 };
+			add_brick(world, pos, quat, size, lamp_color, 0, 0,1);
+			add_brick_light(world->n_bricks-1, light_color, 6);
+			prev_mmb = 1;
+		} else if(!mouse_buttons[2]) prev_mmb = 0;
+
+		// outline the potential brick (10 studs in front of camera)
+		player->show_preview = 1;
+		player->preview_pos = pos;
+		player->preview_size = size;
 	} else {
+		player->show_preview = 0;
 		vec3 v = {0,0,0};
 		if(kbd[0] || kbd[1] || kbd[2] || kbd[3]) {
 			vec4 c4 = { 0,0,1,1 };
@@ -1584,9 +5614,8 @@ void process_input() {
 }
 
 void window_size_callback(GLFWwindow* window, int width, int height) {
-	window_width = width;
-	window_height = height;
-	glViewport(0,0,width,height);
+	settings.window_width = width;
+	settings.window_height = height;
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
@@ -1626,12 +5655,14 @@ void init_gl() {
 	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-	window = glfwCreateWindow(window_width, window_height, window_title, NULL, NULL);
+	if(headless_frames) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	window = glfwCreateWindow(settings.window_width, settings.window_height, window_title, NULL, NULL);
 	if(!window) {
 		printf("glfwCreateWindow() failed to create window. :(\n");
 		exit(1);
 	}
 	glfwMakeContextCurrent(window);
+	if(headless_frames) return;
 	glfwSetCursorPos(window, 0, 0);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window,cursor_pos_callback);
@@ -1641,8 +5672,713 @@ void init_gl() {
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 }
 
-int main() {
+/*==================================================*/
+/*				DYNAMIC RESOLUTION					*/
+/*==================================================*/
+// the scene is rendered into an offscreen framebuffer at render_scale times the window size, then
+// upscaled (bilinear blit) into the window, or the headless framebuffer. GPU frame time is measured
+// with a ring of GL_TIMESTAMP query pairs, read back only once available; every few frames the scale
+// moves toward the one that would fit frame_time_target (fill cost goes with the square of the
+// scale), between MIN_RENDER_SCALE and 1. the framebuffer is allocated at the window size, and a
+// smaller scale only shrinks the viewport within it.
+
+#define MIN_RENDER_SCALE .5f
+#define SCALE_QUERIES 4				// timestamp pairs in flight
+#define SCALE_INTERVAL 8			// frames between scale changes
+#define SCALE_HEADROOM .9f			// aim this far under the target, so the scale doesn't oscillate around it
+#define SCALE_WARMUP 16				// frames whose timings are ignored (shader compiles, first uploads)
+
+uint8_t enable_dynamic_resolution = 1;
+float frame_time_target = 16.6;		// milliseconds of GPU time (--frame-budget)
+float render_scale = 1;
+GLuint scene_fbo, scene_color_id, scene_depth_id;
+GLint scene_width, scene_height;	// allocated size
+GLuint scale_queries[SCALE_QUERIES][2];
+uint8_t scale_pending[SCALE_QUERIES];
+uint32_t scale_frame;
+float scale_gpu_ms;					// smoothed
+GLint scene_target;					// framebuffer the scene is upscaled into
+
+// (re)allocate the scene framebuffer at the window size
+void __size_scene_fbo() {
+	if(scene_fbo && scene_width == (GLint)window_width && scene_height == (GLint)window_height) return;
+	if(!scene_fbo) {
+		GLuint renderbuffers[2];
+		glGenRenderbuffers(2,renderbuffers);
+		scene_color_id = renderbuffers[0], scene_depth_id = renderbuffers[1];
+		glGenFramebuffers(1,&scene_fbo);
+		glGenQueries(SCALE_QUERIES*2, scale_queries[0]);
+	}
+	scene_width = window_width, scene_height = window_height;
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_color_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, scene_width, scene_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_depth_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, scene_width, scene_height);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scene_color_id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scene_depth_id);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("internal error at __size_scene_fbo: scene framebuffer incomplete.\n");
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_target);
+}
+
+// read back finished frame timings, and adjust the scale every SCALE_INTERVAL frames
+void __update_render_scale() {
+	for(uint32_t i = 0; i < SCALE_QUERIES; i++) {
+		if(!scale_pending[i]) continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv(scale_queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) continue;
+		GLuint64 start, end;
+		glGetQueryObjectui64v(scale_queries[i][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(scale_queries[i][1], GL_QUERY_RESULT, &end);
+		float ms = (end - start) / 1e6;
+		if(scale_frame > SCALE_WARMUP)
+			scale_gpu_ms = scale_gpu_ms ? scale_gpu_ms*.8f + ms*.2f : ms;
+		scale_pending[i] = 0;
+	}
+	if(scale_frame % SCALE_INTERVAL || !scale_gpu_ms) return;
+	// GPU time is mostly fill, so it goes with the square of the scale
+	float ideal = render_scale * sqrtf(frame_time_target * SCALE_HEADROOM / scale_gpu_ms);
+	float scale = render_scale + (ideal - render_scale) * .5f;		// halfway there, to damp
+	render_scale = scale < MIN_RENDER_SCALE ? MIN_RENDER_SCALE : scale > 1 ? 1 : scale;
+}
+
+// start a frame: the scene is drawn into the scene framebuffer from here until end_scene_frame
+void begin_scene_frame() {
+	if(!enable_dynamic_resolution) return;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scene_target);
+	__size_scene_fbo();
+	__update_render_scale();
+	uint32_t slot = scale_frame % SCALE_QUERIES;
+	glQueryCounter(scale_queries[slot][0], GL_TIMESTAMP);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+	glViewport(0, 0, scene_width*render_scale, scene_height*render_scale);
+}
+
+// upscale the scene into the framebuffer that was bound at begin_scene_frame
+void end_scene_frame() {
+	if(!enable_dynamic_resolution) return;
+	GLint w = scene_width*render_scale, h = scene_height*render_scale;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scene_target);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, scene_width, scene_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_target);
+	glViewport(0, 0, scene_width, scene_height);
+	uint32_t slot = scale_frame++ % SCALE_QUERIES;
+	glQueryCounter(scale_queries[slot][1], GL_TIMESTAMP);
+	scale_pending[slot] = 1;
+}
+
+/*==================================================*/
+/*				HEADLESS BENCHMARK					*/
+/*==================================================*/
+// with --headless N, the window is hidden and frames are rendered into an offscreen framebuffer
+// while the camera follows a scripted orbit of the origin. the render thread's CPU time of each frame and its GPU
+// time (between two GL_TIMESTAMP queries, so the profiler's GL_TIME_ELAPSED queries can run within
+// it) are printed, then summarized with the profiler's per-pass averages after N frames. run against
+// EGL and Mesa's llvmpipe, this works on machines without a display.
+
+#define BENCH_QUERIES 4			// timer queries in flight; results are read this many frames late
+#define BENCH_WARMUP 2			// frames left out of the summary (shader compiles, first uploads)
+
+GLuint bench_fbo, bench_color_id, bench_depth_id;
+GLuint bench_queries[BENCH_QUERIES][2];		// frame start & end timestamps
+double* bench_cpu_times;		// milliseconds, per frame
+double* bench_gpu_times;
+double bench_frame_start;
+
+void init_headless() {
+	GLuint renderbuffers[2];
+	glGenRenderbuffers(2,renderbuffers);
+	bench_color_id = renderbuffers[0], bench_depth_id = renderbuffers[1];
+	glBindRenderbuffer(GL_RENDERBUFFER, bench_color_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, bench_depth_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, window_width, window_height);
+	glGenFramebuffers(1,&bench_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, bench_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, bench_color_id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, bench_depth_id);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("internal error at init_headless: offscreen framebuffer incomplete.\n");
+		exit(1);
+	}
+	glViewport(0,0,window_width,window_height);
+	glGenQueries(BENCH_QUERIES*2, bench_queries[0]);
+	settings.enable_profiler = 1;
+	bench_cpu_times = calloc(headless_frames, sizeof(double));
+	bench_gpu_times = calloc(headless_frames, sizeof(double));
+}
+
+// wait for a frame's timer queries, and print its times
+void __bench_read_query(uint32_t frame) {
+	GLuint64 start = 0, end = 0;
+	glGetQueryObjectui64v(bench_queries[frame % BENCH_QUERIES][0], GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(bench_queries[frame % BENCH_QUERIES][1], GL_QUERY_RESULT, &end);
+	bench_gpu_times[frame] = (end - start) / 1e6;
+	printf("frame %u: cpu %.3f ms, gpu %.3f ms\n", frame, bench_cpu_times[frame], bench_gpu_times[frame]);
+}
+
+// scripted camera: orbit the origin once every 360 frames, looking down at it (main thread)
+void bench_camera(uint32_t frame) {
+	float angle = frame % 360;
+	player->focused = 0;
+	player->camera.pos.x = sin(angle * 0.0174533) * 60;
+	player->camera.pos.y = 25;
+	player->camera.pos.z = cos(angle * 0.0174533) * 60;
+	vec3 rot = { -20, angle, 0 };
+	player->camera.quat = euler_to_quat(rot);
+}
+
+void bench_begin_frame(uint32_t frame) {
+	glBindFramebuffer(GL_FRAMEBUFFER, bench_fbo);
+	if(frame >= BENCH_QUERIES) __bench_read_query(frame - BENCH_QUERIES);
+	bench_frame_start = glfwGetTime();
+	glQueryCounter(bench_queries[frame % BENCH_QUERIES][0], GL_TIMESTAMP);
+}
+
+void bench_end_frame(uint32_t frame) {
+	glQueryCounter(bench_queries[frame % BENCH_QUERIES][1], GL_TIMESTAMP);
+	bench_cpu_times[frame] = (glfwGetTime() - bench_frame_start) * 1000;
+}
+
+// print the remaining frames and a summary
+void bench_report() {
+	uint32_t n = headless_frames;
+	for(uint32_t i = n > BENCH_QUERIES ? n-BENCH_QUERIES : 0; i < n; i++)
+		__bench_read_query(i);
+	uint32_t first = n > BENCH_WARMUP ? BENCH_WARMUP : 0;
+	double cpu_sum = 0, gpu_sum = 0, cpu_min = 1e9, gpu_min = 1e9, cpu_max = 0, gpu_max = 0;
+	for(uint32_t i = first; i < n; i++) {
+		cpu_sum += bench_cpu_times[i], gpu_sum += bench_gpu_times[i];
+		cpu_min = fmin(cpu_min, bench_cpu_times[i]), cpu_max = fmax(cpu_max, bench_cpu_times[i]);
+		gpu_min = fmin(gpu_min, bench_gpu_times[i]), gpu_max = fmax(gpu_max, bench_gpu_times[i]);
+	}
+	printf("%u frames (after %u warm-up): cpu avg %.3f min %.3f max %.3f ms, gpu avg %.3f min %.3f max %.3f ms\n",
+		n-first, first, cpu_sum/(n-first), cpu_min, cpu_max, gpu_sum/(n-first), gpu_min, gpu_max);
+	profile_report();
+}
+
+/*==================================================*/
+/*				FRAME CAPTURE						*/
+/*==================================================*/
+// frames are captured without stalling: capture_frame starts an asynchronous glReadPixels of the
+// finished frame into one of CAPTURE_SLOTS pixel pack buffers, followed by a fence. update_captures
+// maps a buffer once its fence has passed, a few frames later, and hands a copy of the pixels to
+// the encoder thread, which writes CAPTURE_DIR/frame_N.png (or .ppm with --capture-raw).
+// only when every buffer is still in flight does a new capture wait for the oldest.
+// PNGs are written with stored (uncompressed) deflate blocks, so no compression library is needed
+// and encoding is little more than a copy; they are as large as the raw pixels.
+
+#define CAPTURE_SLOTS 4
+#define CAPTURE_DIR "captures"
+
+typedef struct capture_slot_t {
+	GLuint pbo_id;
+	GLsync fence;
+	uint32_t frame, width, height;
+} capture_slot_t;
+
+typedef struct capture_job_t {
+	uint8_t* pixels;			// RGBA8, bottom row first
+	uint32_t frame, width, height;
+	struct capture_job_t* next;
+} capture_job_t;
+
+capture_slot_t capture_slots[CAPTURE_SLOTS];		// a ring; the ones in flight follow capture_oldest
+uint32_t capture_oldest, n_captures_in_flight;
+capture_job_t* capture_queue, *capture_queue_tail;		// waiting for the encoder
+pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+pthread_t capture_encoder;
+uint8_t capture_encoder_started, capture_encoder_quit;
+uint32_t crc_table[256];
+
+uint32_t __crc32(uint32_t crc, const uint8_t* data, uint32_t size) {
+	if(!crc_table[1])
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for(uint32_t k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+	crc = ~crc;
+	for(uint32_t i = 0; i < size; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+void __put_u32_be(uint8_t* out, uint32_t v) {
+	out[0] = v >> 24, out[1] = v >> 16, out[2] = v >> 8, out[3] = v;
+}
+
+// write a PNG chunk (length, type, data, CRC of type and data) whose data is already at out+8
+uint32_t __png_chunk(uint8_t* out, const char* type, uint32_t size) {
+	__put_u32_be(out, size);
+	memcpy(out+4, type, 4);
+	__put_u32_be(out+8+size, __crc32(0, out+4, size+4));
+	return size+12;
+}
+
+// encode an RGBA8 image (bottom row first) as an RGB PNG; returns its size, the file is in *out
+uint32_t encode_png(uint8_t* pixels, uint32_t width, uint32_t height, uint8_t** out) {
+	uint32_t row_size = width*3 + 1;			// filter type byte, then the row
+	uint32_t raw_size = row_size*height;
+	uint32_t n_blocks = (raw_size + 65534) / 65535;
+	uint32_t zlib_size = 2 + raw_size + n_blocks*5 + 4;
+	uint8_t* png = malloc(8 + 25 + 12+zlib_size + 12);
+	const uint8_t signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+	memcpy(png, signature, 8);
+	uint32_t size = 8;
+
+	uint8_t* ihdr = png+size+8;
+	__put_u32_be(ihdr, width);
+	__put_u32_be(ihdr+4, height);
+	ihdr[8] = 8, ihdr[9] = 2, ihdr[10] = ihdr[11] = ihdr[12] = 0;	// 8 bit RGB, not interlaced
+	size += __png_chunk(png+size, "IHDR", 13);
+
+	// a zlib stream of stored deflate blocks, each holding up to 65535 bytes of filtered rows
+	uint8_t* z = png+size+8;
+	z[0] = 0x78, z[1] = 0x01;
+	uint32_t zi = 2, row_pos = 0, a = 1, b = 0;		// adler32 sums
+	for(uint32_t block = 0; block < n_blocks; block++) {
+		uint32_t len = raw_size - block*65535 < 65535 ? raw_size - block*65535 : 65535;
+		z[zi] = block == n_blocks-1;
+		z[zi+1] = len, z[zi+2] = len >> 8;
+		z[zi+3] = ~len, z[zi+4] = ~len >> 8;
+		zi += 5;
+		for(uint32_t i = 0; i < len; i++, row_pos++) {
+			uint32_t y = row_pos / row_size, x = row_pos % row_size;
+			uint8_t v = x ? pixels[((height-1-y)*width + (x-1)/3)*4 + (x-1)%3] : 0;
+			z[zi++] = v;
+			a = (a + v) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	__put_u32_be(z+zi, b << 16 | a);
+	size += __png_chunk(png+size, "IDAT", zlib_size);
+	size += __png_chunk(png+size, "IEND", 0);
+	*out = png;
+	return size;
+}
+
+void __write_capture(capture_job_t* job) {
+	char path[64];
+	sprintf(path, "%s/frame_%06u.%s", CAPTURE_DIR, job->frame, capture_raw ? "ppm" : "png");
+	FILE* file = fopen(path, "wb");
+	if(!file) {
+		printf("error in __write_capture: failed to open %s for writing.\n", path);
+		return;
+	}
+	if(capture_raw) {
+		fprintf(file, "P6\n%u %u\n255\n", job->width, job->height);
+		uint8_t* row = malloc(job->width*3);
+		for(uint32_t y = job->height; y-- > 0;) {
+			for(uint32_t x = 0; x < job->width; x++)
+				memcpy(&row[x*3], &job->pixels[(y*job->width + x)*4], 3);
+			fwrite(row, 1, job->width*3, file);
+		}
+		free(row);
+	} else {
+		uint8_t* png;
+		uint32_t size = encode_png(job->pixels, job->width, job->height, &png);
+		fwrite(png, 1, size, file);
+		free(png);
+	}
+	fclose(file);
+}
+
+// encode and write captures until capture_encoder_quit is set and the queue is empty
+void* capture_encoder_main(void* unused) {
+	pthread_mutex_lock(&capture_lock);
+	while(1) {
+		while(!capture_queue && !capture_encoder_quit)
+			pthread_cond_wait(&capture_cond, &capture_lock);
+		if(!capture_queue) break;
+		capture_job_t* job = capture_queue;
+		capture_queue = job->next;
+		if(!capture_queue) capture_queue_tail = 0;
+		pthread_mutex_unlock(&capture_lock);
+		__write_capture(job);
+		free(job->pixels);
+		free(job);
+		pthread_mutex_lock(&capture_lock);
+	}
+	pthread_mutex_unlock(&capture_lock);
+	return 0;
+}
+
+// copy the oldest capture's pixels out (waiting for them if they haven't arrived) and queue them
+// for the encoder
+void __finish_capture() {
+	capture_slot_t* slot = &capture_slots[capture_oldest];
+	glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(slot->fence);
+	uint32_t size = slot->width*slot->height*4;
+	capture_job_t* job = malloc(sizeof(capture_job_t));
+	job->pixels = malloc(size);
+	job->frame = slot->frame, job->width = slot->width, job->height = slot->height;
+	job->next = 0;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo_id);
+	memcpy(job->pixels, glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT), size);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	pthread_mutex_lock(&capture_lock);
+	if(capture_queue_tail) capture_queue_tail->next = job;
+	else capture_queue = job;
+	capture_queue_tail = job;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_lock);
+	capture_oldest = (capture_oldest+1) % CAPTURE_SLOTS;
+	n_captures_in_flight--;
+}
+
+// start reading back the frame in the bound draw framebuffer; call once it is completely drawn
+void capture_frame(uint32_t frame) {
+	if(!capture_encoder_started) {
+		mkdir(CAPTURE_DIR, 0755);
+		if(pthread_create(&capture_encoder, 0, capture_encoder_main, 0)) {
+			printf("internal error at capture_frame: failed to create capture encoder thread.\n");
+			exit(1);
+		}
+		capture_encoder_started = 1;
+	}
+	if(n_captures_in_flight == CAPTURE_SLOTS) __finish_capture();
+	capture_slot_t* slot = &capture_slots[(capture_oldest + n_captures_in_flight++) % CAPTURE_SLOTS];
+	if(!slot->pbo_id) glGenBuffers(1,&slot->pbo_id);
+
+	GLint target;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+	glReadBuffer(target ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	slot->frame = frame;
+	slot->width = window_width, slot->height = window_height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo_id);
+	glBufferData(GL_PIXEL_PACK_BUFFER, slot->width*slot->height*4, 0, GL_STREAM_READ);
+	glReadPixels(0, 0, slot->width, slot->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// hand the captures whose readback has finished to the encoder, oldest first
+void update_captures() {
+	while(n_captures_in_flight) {
+		GLenum status = glClientWaitSync(capture_slots[capture_oldest].fence, 0, 0);
+		if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+		__finish_capture();
+	}
+}
+
+// wait for every capture in flight, and for the encoder to write them all
+void finish_captures() {
+	if(!capture_encoder_started) return;
+	while(n_captures_in_flight)
+		__finish_capture();
+	pthread_mutex_lock(&capture_lock);
+	capture_encoder_quit = 1;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_lock);
+	pthread_join(capture_encoder, 0);
+}
+
+/*==================================================*/
+/*				RENDER THREAD						*/
+/*==================================================*/
+// the GL context is owned by a render thread. each frame, the main thread handles input, fills a
+// render packet (camera, overlays, humanoids, lights, and the bricks changed since the last packet)
+// and hands it over, then steps physics for the next frame while the render thread draws and
+// presents this one. there are two packets: the main thread fills one while the render thread draws
+// the other, so the simulation runs at most one frame ahead, and GL driver time doesn't stretch its
+// tick. the render thread keeps its own copy of the world (render_world), updated from the packets,
+// which chunks, vertex pulling and culling work from; nothing it reads is written by the main thread.
+
+pthread_t render_thread;
+pthread_mutex_t packet_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t packet_cond = PTHREAD_COND_INITIALIZER;
+render_packet_t packets[2];
+render_packet_t* ready_packet;	// submitted and not taken by the render thread yet; 0 if none
+uint32_t next_packet;			// the one the main thread fills next
+
+uint32_t* changed_brick_ids;	// bricks edited since the last packet (main thread)
+uint32_t n_changed_brick_ids, max_changed_brick_ids;
+uint32_t* moving_brick_ids;		// bricks that move on their own, sent in every packet
+uint32_t n_moving_brick_ids, max_moving_brick_ids;
+uint8_t* brick_changed;			// per brick; 1 if in changed_brick_ids
+uint8_t* brick_moving;			// per brick; 1 if in moving_brick_ids
+uint32_t n_brick_flags;
+
+void __append_id(uint32_t** ids, uint32_t* n, uint32_t* max, uint32_t id) {
+	if(*n == *max) {
+		*max = *max ? *max*2 : 256;
+		*ids = realloc(*ids, sizeof(uint32_t)*(*max));
+	}
+	(*ids)[(*n)++] = id;
+}
+
+// call after a brick is added or edited, so the render thread picks it up with the next packet
+void dirty_brick(uint32_t brick_id) {
+	if(n_brick_flags < world->n_bricks) {
+		brick_changed = realloc(brick_changed, world->n_bricks);
+		brick_moving = realloc(brick_moving, world->n_bricks);
+		memset(brick_changed+n_brick_flags, 0, world->n_bricks-n_brick_flags);
+		memset(brick_moving+n_brick_flags, 0, world->n_bricks-n_brick_flags);
+		n_brick_flags = world->n_bricks;
+	}
+	if(!brick_changed[brick_id]) {
+		brick_changed[brick_id] = 1;
+		__append_id(&changed_brick_ids, &n_changed_brick_ids, &max_changed_brick_ids, brick_id);
+	}
+	brick_t* brick = &world->bricks[brick_id];
+	if((brick->is_dynamic || brick->has_gravity) && !brick->deleted && !brick_moving[brick_id]) {
+		brick_moving[brick_id] = 1;
+		__append_id(&moving_brick_ids, &n_moving_brick_ids, &max_moving_brick_ids, brick_id);
+	}
+}
+
+void __add_brick_update(render_packet_t* packet, uint32_t brick_id, uint8_t edited) {
+	if(packet->n_brick_updates == packet->max_brick_updates) {
+		packet->max_brick_updates = packet->max_brick_updates ? packet->max_brick_updates*2 : 256;
+		packet->bricks = realloc(packet->bricks, sizeof(brick_t)*packet->max_brick_updates);
+		packet->brick_ids = realloc(packet->brick_ids, sizeof(uint32_t)*packet->max_brick_updates);
+		packet->brick_edited = realloc(packet->brick_edited, packet->max_brick_updates);
+	}
+	packet->bricks[packet->n_brick_updates] = world->bricks[brick_id];
+	packet->brick_ids[packet->n_brick_updates] = brick_id;
+	packet->brick_edited[packet->n_brick_updates++] = edited;
+}
+
+// fill the next render packet from the simulation's current state and hand it to the render thread;
+// waits while the render thread is still behind with the previous one
+void submit_render_packet(uint32_t frame) {
+	pthread_mutex_lock(&packet_lock);
+	while(ready_packet)
+		pthread_cond_wait(&packet_cond, &packet_lock);
+	pthread_mutex_unlock(&packet_lock);
+	render_packet_t* packet = &packets[next_packet];
+	packet->quit = 0;
+	packet->frame = frame;
+	packet->capture = capture_requested;
+	capture_requested = 0;
+	packet->settings = settings;
+	packet->view = update_camera();
+	packet->eye = player->camera.pos;
+
+	// bricks edited since the last packet, then the moving ones that weren't
+	packet->n_bricks = world->n_bricks;
+	packet->n_brick_updates = 0;
+	for(uint32_t i = 0; i < n_changed_brick_ids; i++)
+		__add_brick_update(packet, changed_brick_ids[i], 1);
+	for(uint32_t i = 0; i < n_moving_brick_ids;) {
+		uint32_t brick_id = moving_brick_ids[i];
+		brick_t* brick = &world->bricks[brick_id];
+		if(!(brick->is_dynamic || brick->has_gravity) || brick->deleted) {		// stopped moving or deleted
+			brick_moving[brick_id] = 0;
+			moving_brick_ids[i] = moving_brick_ids[--n_moving_brick_ids];
+			continue;
+		}
+		if(!brick_changed[brick_id]) __add_brick_update(packet, brick_id, 0);
+		i++;
+	}
+	for(uint32_t i = 0; i < n_changed_brick_ids; i++)
+		brick_changed[changed_brick_ids[i]] = 0;
+	n_changed_brick_ids = 0;
+
+	if(packet->max_lights < world->n_lights) {
+		packet->max_lights = world->n_lights;
+		packet->lights = realloc(packet->lights, sizeof(point_light_t)*packet->max_lights);
+	}
+	memcpy(packet->lights, world->lights, sizeof(point_light_t)*world->n_lights);
+	packet->n_lights = world->n_lights;
+
+	if(packet->max_humanoids < n_entities) {
+		packet->max_humanoids = n_entities;
+		packet->humanoids = realloc(packet->humanoids, sizeof(humanoid_instance_t)*packet->max_humanoids);
+	}
+	packet->n_humanoids = 0;
+	for(uint32_t i = 0; i < n_entities; i++) {
+		entity_t* entity = &entities[i];
+		if(!entity->is_humanoid) continue;
+		humanoid_instance_t* instance = &packet->humanoids[packet->n_humanoids++];
+		memcpy(instance->pos, &entity->pos, sizeof(vec3));
+		memcpy(instance->quat, &entity->quat, sizeof(vec4));
+		instance->arms_up = entity->jump_state == 1 && entity->fall_distance > 6;
+		for(uint32_t j = 0; j < 6; j++)
+			instance->colors[j] = pack_color(entity->part_colors[j]);
+	}
+
+	// hand the recorded overlays over, and record the next ones into the packet's old array
+	record_overlay();
+	wire_box_t* boxes = packet->boxes;
+	uint32_t max_boxes = packet->max_boxes;
+	packet->boxes = overlay_boxes, packet->n_boxes = n_overlay_boxes, packet->max_boxes = max_overlay_boxes;
+	overlay_boxes = boxes, n_overlay_boxes = 0, max_overlay_boxes = max_boxes;
+
+	pthread_mutex_lock(&packet_lock);
+	ready_packet = packet;
+	next_packet ^= 1;
+	pthread_cond_broadcast(&packet_cond);
+	pthread_mutex_unlock(&packet_lock);
+}
+
+// bring the render thread's settings and render_world up to date with a packet
+void __apply_render_packet(render_packet_t* packet) {
+	if(window_width != packet->settings.window_width || window_height != packet->settings.window_height) {
+		window_width = packet->settings.window_width;
+		window_height = packet->settings.window_height;
+		if(!headless_frames) glViewport(0,0,window_width,window_height);
+	}
+	brick_render_mode = packet->settings.brick_render_mode;
+	enable_profiler = packet->settings.enable_profiler;
+
+	if(render_world->n_bricks < packet->n_bricks) {		// new bricks are all in the updates
+		render_world->bricks = realloc(render_world->bricks, sizeof(brick_t)*packet->n_bricks);
+		for(uint32_t i = render_world->n_bricks; i < packet->n_bricks; i++)
+			render_world->bricks[i].chunk_id = -1;
+		render_world->n_bricks = packet->n_bricks;
+	}
+	for(uint32_t i = 0; i < packet->n_brick_updates; i++) {
+		brick_t* brick = &render_world->bricks[packet->brick_ids[i]];
+		int32_t chunk_id = brick->chunk_id;		// where the render thread filed it
+		vec3 bake_min = brick->bake_min, bake_max = brick->bake_max;
+		*brick = packet->bricks[i];
+		brick->chunk_id = chunk_id, brick->bake_min = bake_min, brick->bake_max = bake_max;
+		if(packet->brick_edited[i]) refile_brick(packet->brick_ids[i]);
+	}
+
+	if(render_world->n_lights < packet->n_lights)
+		render_world->lights = realloc(render_world->lights, sizeof(point_light_t)*packet->n_lights);
+	memcpy(render_world->lights, packet->lights, sizeof(point_light_t)*packet->n_lights);
+	render_world->n_lights = packet->n_lights;
+}
+
+void* render_thread_main(void* unused) {
+	glfwMakeContextCurrent(window);
+	while(1) {
+		pthread_mutex_lock(&packet_lock);
+		while(!ready_packet)
+			pthread_cond_wait(&packet_cond, &packet_lock);
+		render_packet_t* packet = ready_packet;
+		ready_packet = 0;
+		pthread_cond_broadcast(&packet_cond);
+		pthread_mutex_unlock(&packet_lock);
+		if(packet->quit) break;
+
+		__apply_render_packet(packet);
+		if(headless_frames) bench_begin_frame(packet->frame);
+		begin_scene_frame();
+		glClearColor(0.0,0.2,0.4,1);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		render(packet, 1);
+		render_overlay(packet);
+		end_scene_frame();
+		render_minimap(packet);
+		if(packet->capture || (capture_every && packet->frame % capture_every == 0))
+			capture_frame(packet->frame);
+		update_captures();
+		stream_end_frame();
+		profile_end_frame();
+		if(headless_frames) bench_end_frame(packet->frame);
+		else glfwSwapBuffers(window);
+	}
+	if(headless_frames) bench_report();
+	finish_captures();
+	glfwMakeContextCurrent(0);
+	return 0;
+}
+
+// hand the GL context over to a new render thread; GL must not be used on the main thread after this
+void start_render_thread() {
+	glfwMakeContextCurrent(0);
+	if(pthread_create(&render_thread, 0, render_thread_main, 0)) {
+		printf("internal error at start_render_thread: failed to create render thread.\n");
+		exit(1);
+	}
+}
+
+// let the render thread finish its last frame, and wait for it to exit
+void stop_render_thread() {
+	pthread_mutex_lock(&packet_lock);
+	while(ready_packet)
+		pthread_cond_wait(&packet_cond, &packet_lock);
+	packets[next_packet].quit = 1;
+	ready_packet = &packets[next_packet];
+	pthread_cond_broadcast(&packet_cond);
+	pthread_mutex_unlock(&packet_lock);
+	pthread_join(render_thread, 0);
+}
+
+void print_usage(const char* name) {
+	printf("usage: %s [--headless N] [--frame-budget MS] [--capture-every N] [--capture-raw] [--scene NAME]\n", name);
+}
+
+// extra content added on top of the demo world, for exercising paths the demo alone never reaches
+const char* demo_scene = 0;
+
+void add_demo_scene(const char* name) {
+	vec3 rot = { 0,0,0 };
+	vec4 quat = euler_to_quat(rot);
+	if(!strcmp(name,"glass")) {
+		// a wall of translucent bricks behind the baseplate, past WEIGHTED_OIT_THRESHOLD
+		for(uint32_t x = 0; x < 40; x++)
+		for(uint32_t y = 0; y < 10; y++)
+		for(uint32_t z = 0; z < 3; z++) {
+			vec3 pos = { x-20.f, y-9.f, -14.f-z*1.5f };
+			vec3 scale = { 1,1,1 };
+			vec4 color = { x/40.f, y/10.f, .4f+z*.2f, .35f };
+			add_brick(world, pos, quat, scale, color, 0, 0,0);
+		}
+	} else if(!strcmp(name,"lamps")) {
+		// a 16x16 grid of small lamp bricks over the lower plate, each lighting a few studs around it
+		for(uint32_t x = 0; x < 16; x++)
+		for(uint32_t z = 0; z < 16; z++) {
+			vec3 pos = { x*1.875f-15, -10, z*1.875f-15 };
+			if(pos.x > -10.5f && pos.x < 10 && pos.z > -10.5f && pos.z < 10) pos.y = -9;		// on the baseplate
+			vec3 scale = { .5,.5,.5 };
+			vec3 light_color = { .5f+.5f*sinf(x*.7f), .5f+.5f*sinf(z*.7f+2), .5f+.5f*sinf((x+z)*.35f+4) };
+			vec4 color = { light_color.x, light_color.y, light_color.z, 1 };
+			add_brick(world, pos, quat, scale, color, 0, 0,1);
+			add_brick_light(world->n_bricks-1, light_color, 3);
+		}
+	} else {
+		printf("error: unknown scene '%s'\n", name);
+		exit(1);
+	}
+}
+
+// parse a positive frame count for a command line option, or print usage and exit
+uint32_t __parse_frame_count(const char* arg, const char* option, const char* name) {
+	char* end;
+	long n = strtol(arg, &end, 10);
+	if(end == arg || *end || n <= 0 || n > UINT32_MAX) {
+		printf("error: %s expects a positive number of frames, got '%s'\n", option, arg);
+		print_usage(name);
+		exit(1);
+	}
+	return n;
+}
+
+int main(int argc, char** argv) {
+	for(int i = 1; i < argc; i++)
+		if(!strcmp(argv[i],"--headless") && i+1 < argc) headless_frames = __parse_frame_count(argv[++i], "--headless", argv[0]);
+		else if(!strcmp(argv[i],"--frame-budget") && i+1 < argc) {
+			char* end;
+			frame_time_target = strtod(argv[++i], &end);
+			if(end == argv[i] || *end || !(frame_time_target > 0) || isinf(frame_time_target)) {
+				printf("error: --frame-budget expects a positive number of milliseconds, got '%s'\n", argv[i]);
+				print_usage(argv[0]);
+				exit(1);
+			}
+		}
+		else if(!strcmp(argv[i],"--capture-every") && i+1 < argc) capture_every = __parse_frame_count(argv[++i], "--capture-every", argv[0]);
+		else if(!strcmp(argv[i],"--capture-raw")) capture_raw = 1;
+		else if(!strcmp(argv[i],"--scene") && i+1 < argc) demo_scene = argv[++i];
+
 	init_world();
+	init_workers();
 	player_t local_player = init_player("test_player");
 	player = &local_player;
 	init_gl();
@@ -1673,6 +6409,8 @@ int main() {
 	vec4 color3 = { .4,.4,.8,.5 };
 	add_brick(world, pos3, quat3, scale3, color3, 0, 1,1);
 
+	if(demo_scene) add_demo_scene(demo_scene);
+
 	vec3 cam_rot = { -30,0,0 };
 	player->camera.quat = euler_to_quat(cam_rot);
 	player->camera.pos.z = 10;
@@ -1680,21 +6418,23 @@ int main() {
 
 	glfwPollEvents();
 
-	float frame = 0;
-	while(!glfwWindowShouldClose(window)) {
-		glClearColor(0.0,0.2,0.4,1);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if(headless_frames) init_headless();
+	start_render_thread();
 
+	float frame = 0;
+	while(headless_frames ? frame < headless_frames : !glfwWindowShouldClose(window)) {
+		if(headless_frames) bench_camera(frame);
 		process_input();
-		render(1);
-		if(enable_physics_draw) render_physics();
+		submit_render_packet(frame);		// drawn on the render thread while physics steps
 		physics_step();
 
 		vec3 move = {0,0,cos(frame*0.05)*0.1};
 		translate_brick(2,move);
 
-		glfwSwapBuffers(window);
-		
+		if(headless_frames) {
+			frame++;
+			continue;
+		}
 		struct timespec ts;
 		ts.tv_sec = 0; ts.tv_nsec = 16000000;
 		nanosleep(&ts,&ts);
@@ -1702,6 +6442,7 @@ int main() {
 		glfwPollEvents();
 		frame++;
 	}
+	stop_render_thread();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	return 0;